@@ -0,0 +1,200 @@
+/*
+ * NetEdit -- A network management tool
+ * Copyright (C) 2003-2006 by Mark-André Hopf <mhopf@mark13.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/**
+ * Microbenchmarks for TASN1Encoder and TASN1Decoder with SNMP messages
+ * as sent and received by TSNMPQuery.
+ */
+
+#include "microbench.hh"
+#include "../snmpd/asn1.hh"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+using namespace netedit;
+
+/**
+ * A GetNextRequest-PDU like TSNMPQuery::snmpQuery() creates it.
+ */
+static void
+benchEncodeRequest(TMicroRun &run)
+{
+  for(unsigned long long i=0; i<run.iterations; ++i) {
+    TASN1Encoder out;
+    out.downSequence();
+      out.encodeInteger(0);
+      out.encodeOctetString("public");
+      out.downContext(1);
+        out.encodeInteger(i);
+        out.encodeInteger(0);
+        out.encodeInteger(0);
+        out.downSequence();
+          out.downSequence();
+            out.encodeOID("1.3.6.1.2.1.2.2.1.10.12");
+            out.encodeNull();
+          out.up();
+        out.up();
+      out.up();
+    out.up();
+    keep(out.data);
+  }
+}
+MICROBENCH("asn1/encodeRequest", benchEncodeRequest, 0);
+
+/**
+ * A Response-PDU with 'n' variable bindings from the ifTable.
+ *
+ * TASN1Encoder writes lengths above 127 in base 128 instead of the BER
+ * long form, so it is only used for messages below that size.
+ */
+static string
+response(unsigned n)
+{
+  static const SmiSubid column[] = { 1, 3, 6, 1, 2, 1, 2, 2, 1, 10, 0 };
+  const size_t len = sizeof(column)/sizeof(column[0]);
+
+  TASN1Encoder out;
+  out.downSequence();
+    out.encodeInteger(1);
+    out.encodeOctetString("public");
+    out.downContext(2);
+      out.encodeInteger(4711);
+      out.encodeInteger(0);
+      out.encodeInteger(0);
+      out.downSequence();
+      for(unsigned i=0; i<n; ++i) {
+        out.downSequence();
+          // encodeOID() takes ownership of the array
+          SmiSubid *oid = new SmiSubid[len];
+          memcpy(oid, column, sizeof(column));
+          oid[len-1] = i+1;
+          out.encodeOID(oid, len);
+          out.encodeInteger(123456789 + i);
+        out.up();
+      }
+      out.up();
+    out.up();
+  out.up();
+  return out.data;
+}
+
+static void
+benchEncodeResponse(TMicroRun &run)
+{
+  for(unsigned long long i=0; i<run.iterations; ++i) {
+    string data = response(run.arg);
+    keep(data);
+  }
+}
+MICROBENCH("asn1/encodeResponse", benchEncodeResponse, 1);
+MICROBENCH("asn1/encodeResponse", benchEncodeResponse, 4);
+
+/**
+ * BER encoding of 'content' with the given identifier octet.
+ */
+static string
+tlv(unsigned char identifier, const string &content)
+{
+  string r(1, identifier);
+  size_t n = content.size();
+  if (n < 0x80) {
+    r += (char)n;
+  } else {
+    string len;
+    for(; n; n >>= 8)
+      len.insert(len.begin(), (char)(n & 0xFF));
+    r += (char)(0x80 | len.size());
+    r += len;
+  }
+  return r + content;
+}
+
+/**
+ * Same as response(), but of any size.
+ */
+static string
+largeResponse(unsigned n)
+{
+  string bindings;
+  for(unsigned i=0; i<n; ++i) {
+    char name[64];
+    snprintf(name, sizeof(name), "1.3.6.1.2.1.2.2.1.10.%u", i+1);
+    TASN1Encoder oid, value;
+    oid.encodeOID(name);
+    value.encodeInteger(123456789 + i);
+    bindings += tlv(0x30, oid.data + value.data);
+  }
+  TASN1Encoder head, pdu;
+  head.encodeInteger(1);
+  head.encodeOctetString("public");
+  pdu.encodeInteger(4711);
+  pdu.encodeInteger(0);
+  pdu.encodeInteger(0);
+  return tlv(0x30, head.data + tlv(0xA2, pdu.data + tlv(0x30, bindings)));
+}
+
+/**
+ * Decode a Response-PDU the way TSNMPQuery::canRead() does.
+ */
+static void
+benchDecodeResponse(TMicroRun &run)
+{
+  string data = largeResponse(run.arg);
+  vector<char> buffer(data.begin(), data.end());
+
+  for(unsigned long long i=0; i<run.iterations; ++i) {
+    TASN1Decoder in(&buffer[0], buffer.size());
+    int version, requestID, errorStatus, errorIndex;
+    unsigned cmd;
+    OctetString community;
+    if (!(in.decode() && in.tag==TASN1::SEQUENCE && in.down() &&
+          in.decodeInteger(&version) &&
+          in.decodeOctetString(&community) &&
+          in.decodeContext(&cmd) && in.down() &&
+          in.decodeInteger(&requestID) &&
+          in.decodeInteger(&errorStatus) &&
+          in.decodeInteger(&errorIndex) &&
+          in.downSequence()))
+    {
+      fprintf(stderr, "asn1/decodeResponse: failed to decode message\n");
+      exit(EXIT_FAILURE);
+    }
+    while(in.decode()) {
+      SmiSubid *oid = 0;
+      size_t oidlen;
+      if (in.tag == TASN1::SEQUENCE && in.down() &&
+          in.decodeOID(&oid, &oidlen) &&
+          in.decode())
+      {
+        int value;
+        in.getInteger(&value);
+        keep(value);
+        in.up();
+      }
+      if (oid)
+        delete[] oid;
+    }
+  }
+}
+MICROBENCH("asn1/decodeResponse", benchDecodeResponse, 1);
+MICROBENCH("asn1/decodeResponse", benchDecodeResponse, 20);
@@ -0,0 +1,155 @@
+/*
+ * NetEdit -- A network management tool
+ * Copyright (C) 2003-2006 by Mark-André Hopf <mhopf@mark13.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/**
+ * Microbenchmarks for the protocol codec in lib/binary.hh.
+ */
+
+#include "microbench.hh"
+#include "../lib/common.hh"
+#include "../lib/binary.hh"
+
+#include <string>
+
+using namespace netedit;
+
+static void
+benchAddDWord(TMicroRun &run)
+{
+  string s;
+  for(unsigned long long i=0; i<run.iterations; ++i) {
+    s.clear();
+    addDWord(&s, i);
+    keep(s);
+  }
+}
+MICROBENCH("binary/addDWord", benchAddDWord, 0);
+
+static void
+benchGetDWord(TMicroRun &run)
+{
+  string s;
+  for(unsigned i=0; i<256; ++i)
+    addDWord(&s, i);
+  unsigned p = 0;
+  for(unsigned long long i=0; i<run.iterations; ++i) {
+    if (p>=s.size())
+      p = 0;
+    unsigned v = getDWord(s, &p);
+    keep(v);
+  }
+}
+MICROBENCH("binary/getDWord", benchGetDWord, 0);
+
+static void
+benchAddString(TMicroRun &run)
+{
+  string s;
+  string text(run.arg, 'x');
+  for(unsigned long long i=0; i<run.iterations; ++i) {
+    s.clear();
+    addString(&s, text);
+    keep(s);
+  }
+}
+MICROBENCH("binary/addString", benchAddString, 8);
+MICROBENCH("binary/addString", benchAddString, 256);
+
+static void
+benchGetString(TMicroRun &run)
+{
+  string s;
+  addString(&s, string(run.arg, 'x'));
+  for(unsigned long long i=0; i<run.iterations; ++i) {
+    unsigned p = 0;
+    string v = getString(s, &p);
+    keep(v);
+  }
+}
+MICROBENCH("binary/getString", benchGetString, 8);
+MICROBENCH("binary/getString", benchGetString, 256);
+
+/**
+ * A complete CMD_TRANSLATE_SYMBOL as created by the server for each
+ * broadcast.
+ */
+static void
+benchEncodeTranslate(TMicroRun &run)
+{
+  for(unsigned long long i=0; i<run.iterations; ++i) {
+    string cmd;
+    addDWord(&cmd, 24);
+    addDWord(&cmd, CMD_TRANSLATE_SYMBOL);
+    addSDWord(&cmd, 1);
+    addSDWord(&cmd, i);
+    addSDWord(&cmd, -5);
+    addSDWord(&cmd, 7);
+    keep(cmd);
+  }
+}
+MICROBENCH("binary/encodeTranslate", benchEncodeTranslate, 0);
+
+static void
+benchDecodeTranslate(TMicroRun &run)
+{
+  string cmd;
+  addDWord(&cmd, 24);
+  addDWord(&cmd, CMD_TRANSLATE_SYMBOL);
+  addSDWord(&cmd, 1);
+  addSDWord(&cmd, 4711);
+  addSDWord(&cmd, -5);
+  addSDWord(&cmd, 7);
+  for(unsigned long long i=0; i<run.iterations; ++i) {
+    unsigned p = 0;
+    unsigned n   = getDWord(cmd, &p);
+    unsigned c   = getDWord(cmd, &p);
+    int map      = getSDWord(cmd, &p);
+    int sym      = getSDWord(cmd, &p);
+    int dx       = getSDWord(cmd, &p);
+    int dy       = getSDWord(cmd, &p);
+    keep(n); keep(c); keep(map); keep(sym); keep(dx); keep(dy);
+  }
+}
+MICROBENCH("binary/decodeTranslate", benchDecodeTranslate, 0);
+
+/**
+ * A CMD_MAP_SYMBOLS page with 'arg' symbols.
+ */
+static void
+benchEncodeSymbols(TMicroRun &run)
+{
+  for(unsigned long long i=0; i<run.iterations; ++i) {
+    string msg;
+    addDWord(&msg, 0);
+    addDWord(&msg, CMD_MAP_SYMBOLS);
+    addSDWord(&msg, 1);
+    addDWord(&msg, run.arg);
+    for(unsigned j=0; j<run.arg; ++j) {
+      addSDWord(&msg, j);
+      addSDWord(&msg, 1000+j);
+      addSDWord(&msg, j*32);
+      addSDWord(&msg, j*16);
+      addString(&msg, "router.example.org");
+      addString(&msg, "Cisco:Router");
+    }
+    setDWord(&msg, 0, msg.size());
+    keep(msg);
+  }
+}
+MICROBENCH("binary/encodeSymbols", benchEncodeSymbols, 500);
@@ -0,0 +1,195 @@
+/*
+ * NetEdit -- A network management tool
+ * Copyright (C) 2003-2006 by Mark-André Hopf <mhopf@mark13.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/**
+ * Microbenchmarks for the client's TSNMPTree and TMapModel.
+ *
+ * These are linked against the objects in ../src and need TOAD and the
+ * MIBs in /usr/share/snmp/mibs, see the microbench-client target in the
+ * Makefile.
+ */
+
+#include "microbench.hh"
+#include "../src/snmp.hh"
+#include "../src/mapmodel.hh"
+#include "../src/symbol.hh"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <map>
+
+using namespace netedit;
+
+static void
+release(TSNMPTree::node_t *node)
+{
+  while(node) {
+    TSNMPTree::node_t *next = node->next;
+    release(node->down);
+    delete node;
+    node = next;
+  }
+}
+
+/**
+ * The OIDs of a walk over the system group and an ifTable with 'n'
+ * interfaces, in the order a GetNext walk returns them.
+ */
+static vector<vector<SmiSubid> >
+walk(unsigned n)
+{
+  static const SmiSubid system[] = { 1, 3, 6, 1, 2, 1, 1 };
+  static const SmiSubid ifEntry[] = { 1, 3, 6, 1, 2, 1, 2, 2, 1 };
+  const size_t systemlen = sizeof(system)/sizeof(system[0]);
+  const size_t ifEntrylen = sizeof(ifEntry)/sizeof(ifEntry[0]);
+
+  vector<vector<SmiSubid> > oids;
+  for(SmiSubid i=1; i<=7; ++i) {
+    vector<SmiSubid> oid(system, system+systemlen);
+    oid.push_back(i);
+    oid.push_back(0);
+    oids.push_back(oid);
+  }
+  for(SmiSubid column=1; column<=22; ++column) {
+    for(SmiSubid row=1; row<=n; ++row) {
+      vector<SmiSubid> oid(ifEntry, ifEntry+ifEntrylen);
+      oid.push_back(column);
+      oid.push_back(row);
+      oids.push_back(oid);
+    }
+  }
+  return oids;
+}
+
+/**
+ * Insert a complete walk into a new TSNMPTree, including the libsmi
+ * lookup done by TSNMPQuery::canRead() for each received variable.
+ */
+static void
+benchTreeInsert(TMicroRun &run)
+{
+  run.pause();
+  static bool initialized = false;
+  if (!initialized) {
+    initialize();
+    initialized = true;
+  }
+  vector<vector<SmiSubid> > oids = walk(run.arg);
+  if (!smiGetNodeByOID(oids.back().size(), &oids.back()[0])) {
+    fprintf(stderr, "snmp/treeInsert: IF-MIB is not available\n");
+    exit(EXIT_FAILURE);
+  }
+  string raw("\x02\x04\x07\x5b\xcd\x15", 6);
+  run.resume();
+
+  for(unsigned long long i=0; i<run.iterations; ++i) {
+    TSNMPTree tree;
+    for(size_t j=0; j<oids.size(); ++j) {
+      SmiNode *node = smiGetNodeByOID(oids[j].size(), &oids[j][0]);
+      tree.insert(&oids[j][0], oids[j].size(), node, raw);
+    }
+    run.pause();
+    release(tree.root);
+    run.resume();
+  }
+}
+MICROBENCH("snmp/treeInsert", benchTreeInsert, 10);
+MICROBENCH("snmp/treeInsert", benchTreeInsert, 100);
+
+/**
+ * A map model with 'n' symbols, the ids being 1..n, and a connection
+ * between each pair of neighbours, the ids being 1..n-1.
+ */
+static TMapModel*
+fixture(unsigned n)
+{
+  static map<unsigned, TMapModel*> models;
+  TMapModel *&m = models[n];
+  if (m)
+    return m;
+
+  m = new TMapModel(NULL, 1);
+  for(unsigned i=0; i<n; ++i)
+    m->addSymbol(i+1, (i % 100) * 64, (i / 100) * 64);
+  for(unsigned i=1; i<n; ++i)
+    m->addConnection(i, i, i+1);
+  return m;
+}
+
+static void
+benchDeviceByID(TMicroRun &run)
+{
+  run.pause();
+  TMapModel *m = fixture(run.arg);
+  srand48(run.arg);
+  run.resume();
+
+  for(unsigned long long i=0; i<run.iterations; ++i) {
+    TSymbol *s = m->deviceByID(1 + lrand48() % run.arg);
+    keep(s);
+  }
+}
+MICROBENCH("model/deviceByID", benchDeviceByID, 1000);
+MICROBENCH("model/deviceByID", benchDeviceByID, 10000);
+
+/**
+ * Erase a symbol together with its connection.
+ */
+static void
+benchEraseSymbol(TMicroRun &run)
+{
+  run.pause();
+  TMapModel *m = fixture(run.arg);
+  m->itsme = true;
+  run.resume();
+
+  for(unsigned long long i=0; i<run.iterations; ++i) {
+    run.pause();
+    m->addSymbol(-1, 0, 0);
+    m->addConnection(-1, -1, 1);
+    TFigureSet set;
+    set.insert(m->deviceByID(-1));
+    run.resume();
+    m->erase(set);
+  }
+  m->itsme = false;
+}
+MICROBENCH("model/eraseSymbol", benchEraseSymbol, 1000);
+MICROBENCH("model/eraseSymbol", benchEraseSymbol, 10000);
+
+/**
+ * Delete connections the way CMD_DELETE_CONNECTION does.
+ */
+static void
+benchDeleteConnection(TMicroRun &run)
+{
+  run.pause();
+  TMapModel *m = fixture(run.arg);
+  run.resume();
+
+  for(unsigned long long i=0; i<run.iterations; ++i) {
+    run.pause();
+    m->addConnection(-1, 1, 2);
+    run.resume();
+    m->deleteConnection(-1);
+  }
+}
+MICROBENCH("model/deleteConnection", benchDeleteConnection, 1000);
+MICROBENCH("model/deleteConnection", benchDeleteConnection, 10000);
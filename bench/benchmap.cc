@@ -0,0 +1,169 @@
+/*
+ * NetEdit -- A network management tool
+ * Copyright (C) 2003-2006 by Mark-André Hopf <mhopf@mark13.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/**
+ * Microbenchmarks for the server's TMap with 1k, 10k and 100k symbols.
+ *
+ * The map is linked from ../server/map.o. The clients it broadcasts to
+ * are stubs which drop the messages, so the figures don't include the
+ * cost of queueing them.
+ */
+
+#include "microbench.hh"
+#include "../server/map.hh"
+#include "../server/stats.hh"
+
+#include <stdlib.h>
+#include <math.h>
+#include <map>
+
+using namespace netedit;
+
+TServerStats netedit::stats;
+TMemoryLimits netedit::memorylimits;
+
+void
+TClient::send(const string &msg, EPriority)
+{
+  keep(msg);
+}
+
+bool
+TClient::pendingSymbol(int, int) const
+{
+  return false;
+}
+
+bool
+TClient::pendingConnection(int, int) const
+{
+  return false;
+}
+
+// number of other clients which receive the broadcasts
+static const unsigned OBSERVERS = 4;
+
+static TClient *client = 0;
+
+/**
+ * Add a symbol without going through TMap::addSymbol(), which searches
+ * for an unused id.
+ */
+static void
+place(TMap *m, int id, int x, int y)
+{
+  TMap::TSymbol *s = new TMap::TSymbol;
+  s->symbol_id = id;
+  s->objid     = id;
+  s->x         = x;
+  s->y         = y;
+  s->sysName   = "router";
+  s->type      = "Cisco:Router";
+  m->symbols[id] = s;
+  m->grid.insert(s);
+}
+
+/**
+ * A map with 'n' symbols on a square grid, the ids being 1..n. Maps
+ * are kept between runs and the benchmarks leave them as they found
+ * them.
+ */
+static TMap*
+fixture(unsigned n)
+{
+  static map<unsigned, TMap*> maps;
+  TMap *&m = maps[n];
+  if (m)
+    return m;
+
+  if (!client)
+    client = new TClient(-1);
+  m = new TMap;
+  m->id = 1;
+  m->clients.insert(client);
+  for(unsigned i=0; i<OBSERVERS; ++i)
+    m->clients.insert(new TClient(-1));
+
+  unsigned side = (unsigned)sqrt((double)n) + 1;
+  for(unsigned i=0; i<n; ++i)
+    place(m, i+1, (i % side) * 64, (i / side) * 64);
+  return m;
+}
+
+static void
+benchAddSymbol(TMicroRun &run)
+{
+  run.pause();
+  TMap *m = fixture(run.arg);
+  vector<int> added;
+  added.reserve(run.iterations);
+  run.resume();
+
+  for(unsigned long long i=0; i<run.iterations; ++i)
+    added.push_back(m->addSymbol(client, -1-(int)(i%1000000), 32, 32));
+
+  run.pause();
+  for(size_t i=0; i<added.size(); ++i)
+    m->deleteSymbol(client, added[i]);
+  run.resume();
+}
+MICROBENCH("map/addSymbol", benchAddSymbol, 1000);
+MICROBENCH("map/addSymbol", benchAddSymbol, 10000);
+MICROBENCH("map/addSymbol", benchAddSymbol, 100000);
+
+static void
+benchTranslateSymbol(TMicroRun &run)
+{
+  run.pause();
+  TMap *m = fixture(run.arg);
+  srand48(run.arg);
+  run.resume();
+
+  // every second translation moves the symbol back
+  int sym = 1;
+  for(unsigned long long i=0; i<run.iterations; ++i) {
+    if (i & 1) {
+      m->translateSymbol(client, sym, -300, -300);
+    } else {
+      sym = 1 + lrand48() % run.arg;
+      m->translateSymbol(client, sym, 300, 300);
+    }
+  }
+  if (run.iterations & 1)
+    m->translateSymbol(client, sym, -300, -300);
+}
+MICROBENCH("map/translateSymbol", benchTranslateSymbol, 1000);
+MICROBENCH("map/translateSymbol", benchTranslateSymbol, 10000);
+MICROBENCH("map/translateSymbol", benchTranslateSymbol, 100000);
+
+static void
+benchDeleteSymbol(TMicroRun &run)
+{
+  run.pause();
+  TMap *m = fixture(run.arg);
+  for(unsigned long long i=0; i<run.iterations; ++i)
+    place(m, run.arg+1+i, 32, 32);
+  run.resume();
+
+  for(unsigned long long i=0; i<run.iterations; ++i)
+    m->deleteSymbol(client, run.arg+1+i);
+}
+MICROBENCH("map/deleteSymbol", benchDeleteSymbol, 1000);
+MICROBENCH("map/deleteSymbol", benchDeleteSymbol, 10000);
+MICROBENCH("map/deleteSymbol", benchDeleteSymbol, 100000);
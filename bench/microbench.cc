@@ -0,0 +1,223 @@
+/*
+ * NetEdit -- A network management tool
+ * Copyright (C) 2003-2006 by Mark-André Hopf <mhopf@mark13.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/**
+ * Driver of the microbenchmarks, see microbench.hh.
+ *
+ * Results are printed as a table and, with --json, written as
+ *
+ *   { "label": ..., "date": ..., "host": ..., "compiler": ...,
+ *     "benchmarks": [
+ *       { "name": ..., "arg": ..., "iterations": ...,
+ *         "ns_per_op": median, "min_ns_per_op": ..., "max_ns_per_op": ... },
+ *       ...
+ *     ] }
+ *
+ * so that results of different commits can be compared. --label is
+ * meant for the commit id.
+ */
+
+#include "microbench.hh"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+using namespace netedit;
+
+struct TResult {
+  const TMicroBenchmark *benchmark;
+  unsigned long long iterations;
+  double median, min, max;  // nanoseconds per iteration
+};
+
+static double mintime = 0.2;      // seconds per repetition
+static unsigned repetitions = 5;
+
+static double
+measure(const TMicroBenchmark *b, unsigned long long iterations)
+{
+  TMicroRun run(iterations, b->arg);
+  run.resume();
+  b->function(run);
+  run.pause();
+  return run.elapsed;
+}
+
+static TResult
+execute(const TMicroBenchmark *b)
+{
+  // find the number of iterations needed for 'mintime'
+  unsigned long long iterations = 1;
+  double target = mintime * 1e9;
+  while(true) {
+    double elapsed = measure(b, iterations);
+    if (elapsed >= target)
+      break;
+    double factor = elapsed > 0 ? target / elapsed * 1.2 : 100.0;
+    if (factor > 100.0)
+      factor = 100.0;
+    if (factor < 2.0)
+      factor = 2.0;
+    iterations = (unsigned long long)(iterations * factor);
+  }
+
+  vector<double> times;
+  for(unsigned i=0; i<repetitions; ++i)
+    times.push_back(measure(b, iterations) / iterations);
+  sort(times.begin(), times.end());
+
+  TResult r;
+  r.benchmark = b;
+  r.iterations = iterations;
+  r.median = times[times.size()/2];
+  r.min = times.front();
+  r.max = times.back();
+  return r;
+}
+
+static string
+quote(const string &s)
+{
+  string r = "\"";
+  for(string::const_iterator p = s.begin(); p != s.end(); ++p) {
+    if (*p=='"' || *p=='\\')
+      r += '\\';
+    if ((unsigned char)*p < 0x20)
+      continue;
+    r += *p;
+  }
+  r += '"';
+  return r;
+}
+
+static bool
+writeJSON(const char *filename, const string &label,
+          const vector<TResult> &results)
+{
+  FILE *out = strcmp(filename, "-")==0 ? stdout : fopen(filename, "w");
+  if (!out) {
+    perror(filename);
+    return false;
+  }
+  char date[32], host[256];
+  time_t t = time(NULL);
+  strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&t));
+  if (gethostname(host, sizeof(host))!=0)
+    strcpy(host, "unknown");
+  host[sizeof(host)-1] = 0;
+
+  fprintf(out, "{\n  \"label\": %s,\n  \"date\": %s,\n"
+               "  \"host\": %s,\n  \"compiler\": %s,\n  \"benchmarks\": [\n",
+          quote(label).c_str(), quote(date).c_str(), quote(host).c_str(),
+          quote(__VERSION__).c_str());
+  for(size_t i=0; i<results.size(); ++i) {
+    const TResult &r = results[i];
+    fprintf(out, "    { \"name\": %s, \"arg\": %llu, \"iterations\": %llu, "
+                 "\"ns_per_op\": %.3f, \"min_ns_per_op\": %.3f, "
+                 "\"max_ns_per_op\": %.3f }%s\n",
+            quote(r.benchmark->name).c_str(), r.benchmark->arg, r.iterations,
+            r.median, r.min, r.max, i+1<results.size() ? "," : "");
+  }
+  fprintf(out, "  ]\n}\n");
+  if (out!=stdout)
+    fclose(out);
+  return true;
+}
+
+static void
+usage()
+{
+  fprintf(stderr,
+    "usage: microbench [options]\n"
+    "  --filter <text>      only run benchmarks with <text> in their name\n"
+    "  --min-time <sec>     minimal time per repetition (0.2)\n"
+    "  --repetitions <n>    number of measured repetitions (5)\n"
+    "  --json <file>        write the results as JSON, '-' for stdout\n"
+    "  --label <text>       label stored in the JSON output, e.g. a commit\n"
+    "  --list               list the benchmarks\n");
+  exit(EXIT_FAILURE);
+}
+
+int
+main(int argc, char **argv)
+{
+  const char *filter = "";
+  const char *json = 0;
+  string label;
+  bool list = false;
+  for(int i=1; i<argc; ++i) {
+    if (strcmp(argv[i], "--list")==0) {
+      list = true;
+      continue;
+    }
+    if (i+1>=argc)
+      usage();
+    if (strcmp(argv[i], "--filter")==0) {
+      filter = argv[++i];
+    } else
+    if (strcmp(argv[i], "--min-time")==0) {
+      mintime = atof(argv[++i]);
+    } else
+    if (strcmp(argv[i], "--repetitions")==0) {
+      repetitions = atoi(argv[++i]);
+    } else
+    if (strcmp(argv[i], "--json")==0) {
+      json = argv[++i];
+    } else
+    if (strcmp(argv[i], "--label")==0) {
+      label = argv[++i];
+    } else {
+      usage();
+    }
+  }
+  if (mintime<=0.0 || repetitions==0)
+    usage();
+
+  vector<TResult> results;
+  const vector<TMicroBenchmark*> &all = TMicroBenchmark::all();
+  // the JSON output may go to stdout, so the table goes to stderr then
+  FILE *table = json && strcmp(json, "-")==0 ? stderr : stdout;
+  if (!list)
+    fprintf(table, "%-36s %10s %14s %14s %14s\n",
+            "benchmark", "arg", "ns/op", "min", "max");
+  for(size_t i=0; i<all.size(); ++i) {
+    const TMicroBenchmark *b = all[i];
+    if (!strstr(b->name, filter))
+      continue;
+    if (list) {
+      printf("%s %llu\n", b->name, b->arg);
+      continue;
+    }
+    TResult r = execute(b);
+    fprintf(table, "%-36s %10llu %14.1f %14.1f %14.1f\n",
+            b->name, b->arg, r.median, r.min, r.max);
+    fflush(table);
+    results.push_back(r);
+  }
+  if (json && !list && !writeJSON(json, label, results))
+    return EXIT_FAILURE;
+  return 0;
+}
@@ -0,0 +1,115 @@
+/*
+ * NetEdit -- A network management tool
+ * Copyright (C) 2003-2006 by Mark-André Hopf <mhopf@mark13.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __NETEDIT_MICROBENCH_HH
+#define __NETEDIT_MICROBENCH_HH
+
+#include <time.h>
+#include <vector>
+
+/**
+ * A minimal microbenchmark harness.
+ *
+ *   static void
+ *   benchDWord(TMicroRun &run)
+ *   {
+ *     string s;
+ *     for(unsigned long long i=0; i<run.iterations; ++i) {
+ *       s.clear();
+ *       addDWord(&s, i);
+ *       keep(s);
+ *     }
+ *   }
+ *   MICROBENCH("binary/addDWord", benchDWord, 0);
+ *
+ * The harness calls the function with a growing number of iterations
+ * until a run takes at least --min-time, then repeats it and reports the
+ * median time per iteration. Setup which shouldn't be measured is put
+ * between run.pause() and run.resume(). 'arg' is passed on in run.arg,
+ * e.g. to run the same benchmark for different sizes.
+ */
+
+namespace netedit {
+
+using namespace std;
+
+class TMicroRun
+{
+    unsigned long long started;
+  public:
+    unsigned long long iterations;
+    unsigned long long arg;
+    unsigned long long elapsed;   // nanoseconds
+
+    static unsigned long long clock() {
+      timespec t;
+      clock_gettime(CLOCK_MONOTONIC, &t);
+      return (unsigned long long)t.tv_sec * 1000000000 + t.tv_nsec;
+    }
+
+    TMicroRun(unsigned long long iterations, unsigned long long arg) {
+      this->iterations = iterations;
+      this->arg = arg;
+      elapsed = 0;
+      started = 0;
+    }
+    void resume() { started = clock(); }
+    void pause() { elapsed += clock() - started; }
+};
+
+typedef void (*TMicroFunction)(TMicroRun&);
+
+struct TMicroBenchmark
+{
+  TMicroBenchmark(const char *name, TMicroFunction function,
+                  unsigned long long arg)
+  {
+    this->name = name;
+    this->function = function;
+    this->arg = arg;
+    all().push_back(this);
+  }
+  const char *name;
+  TMicroFunction function;
+  unsigned long long arg;
+
+  static vector<TMicroBenchmark*>& all() {
+    static vector<TMicroBenchmark*> list;
+    return list;
+  }
+};
+
+/**
+ * Keep the compiler from optimizing away the computation of 'v'.
+ */
+template <class T>
+inline void
+keep(const T &v)
+{
+  asm volatile("" : : "g"(&v) : "memory");
+}
+
+} // namespace netedit
+
+#define MICROBENCH_ID2(line) _microbench_##line
+#define MICROBENCH_ID(line) MICROBENCH_ID2(line)
+#define MICROBENCH(name, function, arg) \
+  static netedit::TMicroBenchmark MICROBENCH_ID(__LINE__)(name, function, arg)
+
+#endif
@@ -0,0 +1,956 @@
+/*
+ * NetEdit -- A network management tool
+ * Copyright (C) 2003-2006 by Mark-André Hopf <mhopf@mark13.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/**
+ * NetEdit Server Benchmark
+ *
+ * Simulates a number of clients which open the same map and then
+ * perform a random mix of operations at a given rate:
+ *
+ *   open       close and reopen the map, until CMD_MAP_END is received
+ *   translate  move a symbol, no reply but a broadcast to the others
+ *   add        add a symbol, until CMD_RENAME_SYMBOL is received
+ *   node       open a node, until CMD_OPEN_NODE is received
+ *   lock       open and lock a node, until CMD_LOCK_NODE is received
+ *   ping       send a heartbeat, until it's echoed
+ *
+ * Operations are started at exponentially distributed intervals and
+ * each client waits for the reply to an operation before starting the
+ * next one. Round trip times are measured from the time an operation
+ * was scheduled, not when it was actually sent, so that a stalled
+ * server shows up in the latencies instead of just lowering the rate.
+ *
+ * Fan-out latency is the time from sending a translate or add until
+ * another client receives the broadcast, for every receiving client.
+ *
+ * Symbols added are deleted again at the end of the run.
+ *
+ * With --stats the server's own statistics (CMD_GET_STATS) are printed
+ * after the run.
+ */
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+#include <time.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+#include "../lib/common.hh"
+#include "../lib/binary.hh"
+#include "../lib/histogram.hh"
+
+using namespace std;
+using namespace netedit;
+
+typedef THistogram::TValue TTime; // microseconds
+
+static TTime
+now()
+{
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (TTime)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+enum EOp {
+  OP_OPEN,
+  OP_TRANSLATE,
+  OP_ADD,
+  OP_NODE,
+  OP_LOCK,
+  OP_PING,
+  OP_MAX
+};
+
+static const char *opname[OP_MAX] = {
+  "open", "translate", "add", "node", "lock", "ping"
+};
+
+// relative frequency of the operations
+static unsigned mix[OP_MAX] = { 1, 60, 5, 15, 5, 14 };
+
+struct TOpStats {
+  TOpStats() { sent = failed = 0; }
+  unsigned long long sent, failed;
+  THistogram rtt;     // round trip time
+  THistogram fanout;  // time until another client received the update
+};
+static TOpStats stats[OP_MAX];
+
+/**
+ * Send times of updates which are broadcast to the other clients, keyed
+ * by a value which is unique for the update.
+ */
+typedef map<long long, TTime> TPending;
+static TPending pending[OP_MAX];
+
+static const char *host = "127.0.0.1";
+static unsigned port = 15001;
+static unsigned nclients = 10;
+static int map_id = 1;
+static unsigned nnodes = 0;
+static double rate = 10.0;   // operations per second and client
+static unsigned duration = 30;
+static unsigned warmup = 2;
+static TTime timeout = 5000000;
+
+static bool showstats = false;
+
+static bool measuring = false;
+static unsigned seq = 0;     // source for unique keys
+static bool gotstats = false;
+
+static TTime
+interval()
+{
+  return (TTime)(-log(1.0 - drand48()) / rate * 1000000.0);
+}
+
+static EOp
+chooseOp()
+{
+  unsigned total = 0;
+  for(unsigned i=0; i<OP_MAX; ++i)
+    total += mix[i];
+  unsigned r = lrand48() % total;
+  for(unsigned i=0; i<OP_MAX; ++i) {
+    if (r < mix[i])
+      return (EOp)i;
+    r -= mix[i];
+  }
+  return OP_PING;
+}
+
+static string
+frame(unsigned cmd)
+{
+  string msg;
+  addDWord(&msg, 0);
+  addDWord(&msg, cmd);
+  return msg;
+}
+
+static void printServerStats(const string &in, unsigned *p);
+
+class TBenchClient
+{
+  public:
+    TBenchClient(unsigned n);
+    ~TBenchClient();
+
+    int fd;
+    unsigned n;          // number of this client
+    string in, out;
+    bool ready;          // the map has been received
+    vector<int> symbols; // symbols in the map
+    vector<int> nodes;   // nodes referenced by the symbols
+    vector<int> own;     // symbols added by this client
+
+    // the operation which waits for a reply
+    bool busy;
+    EOp op;
+    int key;
+    int step;
+    TTime started;       // when the operation was scheduled
+    TTime deadline;
+
+    TTime next;          // when the next operation is scheduled
+    int tempid;          // last temporary symbol id
+    int undo_sym, undo_dx;  // translation to be reverted next
+
+    bool connect();
+    void send(string msg);
+    bool canRead();
+    bool canWrite();
+    void start(TTime t);
+    void finish(bool ok);
+    void expire(TTime t);
+    void cleanup();
+
+  protected:
+    void execute();
+    int randomNode();
+    void received(EOp op, long long key, TTime t);
+};
+
+TBenchClient::TBenchClient(unsigned n)
+{
+  this->n = n;
+  fd = -1;
+  ready = false;
+  busy = false;
+  tempid = 0;
+  undo_sym = -1;
+  undo_dx = 0;
+}
+
+TBenchClient::~TBenchClient()
+{
+  if (fd!=-1)
+    close(fd);
+}
+
+bool
+TBenchClient::connect()
+{
+  sockaddr_in name;
+  in_addr ia;
+  if (inet_aton(host, &ia)!=0) {
+    name.sin_addr.s_addr = ia.s_addr;
+  } else {
+    struct hostent *hostinfo;
+    hostinfo = gethostbyname(host);
+    if (hostinfo==0) {
+      cerr << "couldn't resolve hostname '" << host << "'" << endl;
+      return false;
+    }
+    name.sin_addr = *(struct in_addr *) hostinfo->h_addr;
+  }
+  name.sin_family = AF_INET;
+  name.sin_port   = htons(port);
+
+  fd = socket (AF_INET, SOCK_STREAM, 0);
+  if (fd==-1) {
+    perror("failed to create socket");
+    return false;
+  }
+
+  int yes = 1;
+  if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(int))<0) {
+    perror("failed to set TCP_NODELAY");
+  }
+
+  if (::connect(fd, (sockaddr*) &name, sizeof(sockaddr_in)) < 0) {
+    perror("couldn't connect to server");
+    return false;
+  }
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+
+  char login[32];
+  snprintf(login, sizeof(login), "bench%u", n);
+  string msg = frame(CMD_LOGIN);
+  addString(&msg, login);
+  addString(&msg, "");
+  send(msg);
+
+  msg = frame(CMD_OPEN_MAP);
+  addSDWord(&msg, map_id);
+  send(msg);
+  return true;
+}
+
+void
+TBenchClient::send(string msg)
+{
+  setDWord(&msg, 0, msg.size());
+  out += msg;
+}
+
+bool
+TBenchClient::canWrite()
+{
+  while(!out.empty()) {
+    ssize_t n = write(fd, out.c_str(), out.size());
+    if (n<0) {
+      if (errno==EINTR)
+        continue;
+      if (errno==EAGAIN)
+        break;
+      perror("error when writing to server");
+      return false;
+    }
+    out.erase(0, n);
+  }
+  return true;
+}
+
+bool
+TBenchClient::canRead()
+{
+  while(true) {
+    char cbuffer[65536];
+    ssize_t n = read(fd, cbuffer, sizeof(cbuffer));
+    if (n==0) {
+      cerr << "client " << this->n << " lost connection to server" << endl;
+      return false;
+    }
+    if (n<0) {
+      if (errno==EINTR)
+        continue;
+      if (errno==EAGAIN)
+        break;
+      perror("error when reading from server");
+      return false;
+    }
+    in.append(cbuffer, n);
+  }
+  execute();
+  return true;
+}
+
+int
+TBenchClient::randomNode()
+{
+  if (nnodes)
+    return 1 + lrand48() % nnodes;
+  if (nodes.empty())
+    return -1;
+  return nodes[lrand48() % nodes.size()];
+}
+
+/**
+ * Start the operation scheduled for time 't'.
+ */
+void
+TBenchClient::start(TTime t)
+{
+  op = chooseOp();
+  if ((op==OP_TRANSLATE && symbols.empty()) ||
+      ((op==OP_NODE || op==OP_LOCK) && randomNode()==-1))
+  {
+    op = OP_PING;
+  }
+  if (measuring)
+    ++stats[op].sent;
+
+  string msg;
+  started = t;
+  deadline = now() + timeout;
+  step = 0;
+  busy = true;
+  switch(op) {
+    case OP_OPEN:
+      ready = false;
+      msg = frame(CMD_CLOSE_MAP);
+      addSDWord(&msg, map_id);
+      send(msg);
+      msg = frame(CMD_OPEN_MAP);
+      addSDWord(&msg, map_id);
+      send(msg);
+      break;
+
+    case OP_TRANSLATE: {
+      // every second translation reverts the previous one so that the
+      // map stays as it was
+      int sym, dx;
+      if (undo_sym!=-1) {
+        sym = undo_sym;
+        dx  = -undo_dx;
+        undo_sym = -1;
+      } else {
+        sym = symbols[lrand48() % symbols.size()];
+        dx  = 1 + seq++ % 0x3fffffff;
+        undo_sym = sym;
+        undo_dx  = dx;
+      }
+      msg = frame(CMD_TRANSLATE_SYMBOL);
+      addSDWord(&msg, map_id);
+      addSDWord(&msg, sym);
+      addSDWord(&msg, dx);
+      addSDWord(&msg, 0);
+      send(msg);
+      pending[OP_TRANSLATE][((long long)sym << 32) | (unsigned)dx] = now();
+      busy = false;
+    } break;
+
+    case OP_ADD: {
+      key = --tempid;
+      int x = 1000 + seq++ % 1000000;
+      msg = frame(CMD_ADD_SYMBOL);
+      addSDWord(&msg, map_id);
+      addSDWord(&msg, key);
+      addSDWord(&msg, x);
+      addSDWord(&msg, 32 * (n%64));
+      send(msg);
+      pending[OP_ADD][x] = now();
+    } break;
+
+    case OP_NODE:
+      key = randomNode();
+      msg = frame(CMD_OPEN_NODE);
+      addDWord(&msg, key);
+      send(msg);
+      break;
+
+    case OP_LOCK:
+      key = randomNode();
+      msg = frame(CMD_OPEN_NODE);
+      addDWord(&msg, key);
+      send(msg);
+      msg = frame(CMD_LOCK_NODE);
+      addDWord(&msg, key);
+      send(msg);
+      break;
+
+    default:
+      key = seq++;
+      msg = frame(CMD_HEARTBEAT);
+      addDWord(&msg, key);
+      send(msg);
+  }
+}
+
+void
+TBenchClient::finish(bool ok)
+{
+  busy = false;
+  if (!measuring)
+    return;
+  if (ok)
+    stats[op].rtt.record(now() - started);
+  else
+    ++stats[op].failed;
+}
+
+/**
+ * Give up waiting for a reply.
+ */
+void
+TBenchClient::expire(TTime t)
+{
+  if (!busy || t < deadline)
+    return;
+  if (op==OP_NODE || op==OP_LOCK) {
+    string msg = frame(CMD_CLOSE_NODE);
+    addDWord(&msg, key);
+    send(msg);
+  }
+  if (op==OP_OPEN)
+    ready = true;
+  finish(false);
+}
+
+/**
+ * Another client's update was received.
+ */
+void
+TBenchClient::received(EOp op, long long key, TTime t)
+{
+  if (!measuring)
+    return;
+  TPending::iterator p = pending[op].find(key);
+  if (p!=pending[op].end())
+    stats[op].fanout.record(t - p->second);
+}
+
+void
+TBenchClient::execute()
+{
+  TTime t = now();
+  while(in.size()>=8) {
+    unsigned p = 0;
+    size_t n = getDWord(in, &p);
+    if (n<8) {
+      cerr << "client " << this->n << " received malformed message" << endl;
+      in.clear();
+      break;
+    }
+    if (in.size() < n)
+      break;
+    unsigned cmd = getDWord(in, &p);
+    switch(cmd) {
+      case CMD_OPEN_MAP:
+        if (getSDWord(in, &p)==map_id) {
+          symbols.clear();
+          nodes.clear();
+        }
+        break;
+
+      case CMD_MAP_SYMBOLS: {
+        if (getSDWord(in, &p)!=map_id)
+          break;
+        unsigned count = getDWord(in, &p);
+        // symbol, object, x, y, sysName and type, the strings being
+        // at least their length each
+        for(unsigned i=0; i<count; ++i) {
+          if (p+24 > n) {
+            cerr << "client " << this->n << " received truncated symbols" << endl;
+            break;
+          }
+          int sym   = getSDWord(in, &p);
+          int objid = getSDWord(in, &p);
+          getSDWord(in, &p);
+          getSDWord(in, &p);
+          getString(in, &p);
+          getString(in, &p);
+          if (p > n) {
+            cerr << "client " << this->n << " received truncated symbols" << endl;
+            break;
+          }
+          symbols.push_back(sym);
+          if (objid>0)
+            nodes.push_back(objid);
+        }
+      } break;
+
+      case CMD_MAP_END:
+        if (getSDWord(in, &p)!=map_id)
+          break;
+        ready = true;
+        if (busy && op==OP_OPEN)
+          finish(true);
+        break;
+
+      case CMD_ADD_SYMBOL: {
+        getSDWord(in, &p);
+        int sym = getSDWord(in, &p);
+        int x   = getSDWord(in, &p);
+        symbols.push_back(sym);
+        received(OP_ADD, x, t);
+      } break;
+
+      case CMD_RENAME_SYMBOL: {
+        int map    = getSDWord(in, &p);
+        int old_id = getSDWord(in, &p);
+        int new_id = getSDWord(in, &p);
+        string msg = frame(CMD_RENAME_SYMBOL);
+        addSDWord(&msg, map);
+        addSDWord(&msg, old_id);
+        addSDWord(&msg, new_id);
+        send(msg);
+        symbols.push_back(new_id);
+        own.push_back(new_id);
+        if (busy && op==OP_ADD && key==old_id)
+          finish(true);
+      } break;
+
+      case CMD_DELETE_SYMBOL: {
+        getSDWord(in, &p);
+        int sym = getSDWord(in, &p);
+        vector<int>::iterator q = find(symbols.begin(), symbols.end(), sym);
+        if (q!=symbols.end()) {
+          *q = symbols.back();
+          symbols.pop_back();
+        }
+        if (undo_sym==sym)
+          undo_sym = -1;
+      } break;
+
+      case CMD_TRANSLATE_SYMBOL: {
+        getSDWord(in, &p);
+        int sym = getSDWord(in, &p);
+        int dx  = getSDWord(in, &p);
+        received(OP_TRANSLATE, ((long long)sym << 32) | (unsigned)dx, t);
+      } break;
+
+      case CMD_OPEN_NODE: {
+        int node  = getDWord(in, &p);
+        int state = getDWord(in, &p);
+        if (!busy || key!=node || step!=0)
+          break;
+        if (op==OP_NODE) {
+          finish(state!=NODE_IS_NOT);
+        } else if (op==OP_LOCK) {
+          if (state==NODE_UNLOCKED) {
+            step = 1;
+            break;
+          }
+          finish(false);
+        } else {
+          break;
+        }
+        string msg = frame(CMD_CLOSE_NODE);
+        addDWord(&msg, node);
+        send(msg);
+      } break;
+
+      case CMD_LOCK_NODE: {
+        int node  = getDWord(in, &p);
+        int state = getByte(in, &p);
+        bool waiting = busy && op==OP_LOCK && key==node && step==1;
+        if (state==NODE_LOCKED_LOCAL) {
+          string msg = frame(CMD_UNLOCK_NODE);
+          addDWord(&msg, node);
+          send(msg);
+        }
+        if (waiting) {
+          finish(state==NODE_LOCKED_LOCAL);
+          string msg = frame(CMD_CLOSE_NODE);
+          addDWord(&msg, node);
+          send(msg);
+        }
+      } break;
+
+      case CMD_HEARTBEAT:
+        if (n>=12 && busy && op==OP_PING && key==(int)getDWord(in, &p))
+          finish(true);
+        break;
+
+      case CMD_GET_STATS:
+        printServerStats(in, &p);
+        gotstats = true;
+        break;
+    }
+    in.erase(0, n);
+  }
+}
+
+/**
+ * Delete the symbols added during the run.
+ */
+void
+TBenchClient::cleanup()
+{
+  for(vector<int>::iterator p = own.begin();
+      p != own.end();
+      ++p)
+  {
+    string msg = frame(CMD_DELETE_SYMBOL);
+    addSDWord(&msg, map_id);
+    addSDWord(&msg, *p);
+    send(msg);
+  }
+  own.clear();
+}
+
+static void
+printHistogram(const char *name, const string &in, unsigned *p)
+{
+  unsigned long long count = getQWord(in, p);
+  unsigned long long p50   = getQWord(in, p);
+  unsigned long long p99   = getQWord(in, p);
+  unsigned long long p999  = getQWord(in, p);
+  unsigned long long max   = getQWord(in, p);
+  printf("%-24s %9llu %9llu %9llu %9llu %9llu\n",
+         name, count, p50, p99, p999, max);
+}
+
+/**
+ * Print the reply to CMD_GET_STATS.
+ */
+static void
+printServerStats(const string &in, unsigned *p)
+{
+  unsigned uptime  = getDWord(in, p);
+  unsigned clients = getDWord(in, p);
+  printf("\nserver: uptime %us, %u clients\n\n", uptime, clients);
+  printf("%-24s %9s %9s %9s %9s %9s %9s %9s\n",
+         "command", "count", "in KB", "out KB",
+         "p50 us", "p99 us", "p999 us", "max us");
+  unsigned n = getDWord(in, p);
+  for(unsigned i=0; i<n; ++i) {
+    unsigned cmd = getDWord(in, p);
+    unsigned long long count = getQWord(in, p);
+    unsigned long long bin   = getQWord(in, p);
+    unsigned long long bout  = getQWord(in, p);
+    getQWord(in, p);
+    unsigned long long p50   = getQWord(in, p);
+    unsigned long long p99   = getQWord(in, p);
+    unsigned long long p999  = getQWord(in, p);
+    unsigned long long max   = getQWord(in, p);
+    printf("%-24s %9llu %9llu %9llu %9llu %9llu %9llu %9llu\n",
+           cmd ? commandName(cmd) : "OTHER", count, bin/1024, bout/1024,
+           p50, p99, p999, max);
+  }
+  printf("\n%-24s %9s %9s %9s %9s %9s\n",
+         "", "count", "p50", "p99", "p999", "max");
+  printHistogram("fan-out (clients)", in, p);
+  n = getDWord(in, p);
+  for(unsigned i=0; i<n; ++i) {
+    string site = "sql " + getString(in, p);
+    printHistogram((site + " (us)").c_str(), in, p);
+    printHistogram((site + " (rows)").c_str(), in, p);
+    unsigned long long slow = getQWord(in, p);
+    if (slow)
+      printf("%-24s %9llu\n", (site + " (slow)").c_str(), slow);
+  }
+
+  printf("\n%-24s %9s %9s %9s %9s\n",
+         "memory (KB)", "clients", "symbols", "conns", "strings");
+  n = getDWord(in, p);
+  for(unsigned i=0; i<n; ++i) {
+    int map = getSDWord(in, p);
+    unsigned users = getDWord(in, p);
+    unsigned long long symbols = getQWord(in, p);
+    unsigned long long conns   = getQWord(in, p);
+    unsigned long long strings = getQWord(in, p);
+    printf("map %-20d %9u %9llu %9llu %9llu\n",
+           map, users, symbols/1024, conns/1024, strings/1024);
+  }
+  unsigned nodes = getDWord(in, p);
+  unsigned long long nodebytes = getQWord(in, p);
+  printf("%-24s %9u %9llu\n", "nodes", nodes, nodebytes/1024);
+  printf("%-24s %9s %9s %9s\n", "", "input", "mappings", "output");
+  n = getDWord(in, p);
+  for(unsigned i=0; i<n; ++i) {
+    string login = "client " + getString(in, p);
+    unsigned long long input    = getQWord(in, p);
+    unsigned long long mappings = getQWord(in, p);
+    unsigned long long output   = getQWord(in, p);
+    printf("%-24s %9llu %9llu %9llu\n",
+           login.c_str(), input/1024, mappings/1024, output/1024);
+  }
+}
+
+static void
+usage()
+{
+  fprintf(stderr,
+    "usage: neteditbench [options]\n"
+    "  --host <host>        server to connect to (127.0.0.1)\n"
+    "  --port <port>        port of the server (15001)\n"
+    "  --clients <n>        number of simulated clients (10)\n"
+    "  --map <id>           map opened by all clients (1)\n"
+    "  --nodes <n>          use node ids 1..n instead of those in the map\n"
+    "  --rate <ops>         operations per second and client (10)\n"
+    "  --duration <sec>     length of the measurement (30)\n"
+    "  --warmup <sec>       time before the measurement starts (2)\n"
+    "  --timeout <sec>      time to wait for a reply (5)\n"
+    "  --stats              print the server's statistics after the run\n"
+    "  --mix <op>=<weight>,...\n"
+    "                       relative frequency of the operations open,\n"
+    "                       translate, add, node, lock and ping\n"
+    "                       (open=1,translate=60,add=5,node=15,lock=5,ping=14)\n");
+  exit(EXIT_FAILURE);
+}
+
+static void
+parseMix(const char *arg)
+{
+  string s(arg);
+  size_t p = 0;
+  while(p < s.size()) {
+    size_t e = s.find(',', p);
+    if (e==string::npos)
+      e = s.size();
+    string item = s.substr(p, e-p);
+    size_t eq = item.find('=');
+    unsigned i;
+    for(i=0; i<OP_MAX; ++i) {
+      if (eq!=string::npos && item.substr(0, eq)==opname[i])
+        break;
+    }
+    if (i==OP_MAX) {
+      fprintf(stderr, "unknown operation in '%s'\n", item.c_str());
+      exit(EXIT_FAILURE);
+    }
+    mix[i] = atoi(item.c_str()+eq+1);
+    p = e+1;
+  }
+  unsigned total = 0;
+  for(unsigned i=0; i<OP_MAX; ++i)
+    total += mix[i];
+  if (total==0) {
+    fprintf(stderr, "all operations have a weight of 0\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void
+printRow(const char *name, unsigned long long count, unsigned long long failed,
+         double seconds, const THistogram &h)
+{
+  printf("%-12s %9llu %7llu %9.1f", name, count, failed, count / seconds);
+  if (h.count()==0) {
+    printf("        -        -        -        -\n");
+    return;
+  }
+  printf(" %8.3f %8.3f %8.3f %8.3f\n",
+    h.percentile(50.0) / 1000.0,
+    h.percentile(99.0) / 1000.0,
+    h.percentile(99.9) / 1000.0,
+    h.max() / 1000.0);
+}
+
+static void
+report(double seconds)
+{
+  printf("\n%u clients, %.1f operations/s each, measured %.1fs\n\n",
+         nclients, rate, seconds);
+  printf("round trip   %9s %7s %9s %8s %8s %8s %8s\n",
+         "count", "failed", "ops/s", "p50 ms", "p99 ms", "p999 ms", "max ms");
+  unsigned long long total = 0;
+  for(unsigned i=0; i<OP_MAX; ++i) {
+    if (mix[i]==0)
+      continue;
+    const TOpStats &s = stats[i];
+    unsigned long long done = i==OP_TRANSLATE ? s.sent : s.rtt.count();
+    total += done;
+    printRow(opname[i], done, s.failed, seconds, s.rtt);
+  }
+  printf("\nfan-out\n");
+  printRow("translate", stats[OP_TRANSLATE].fanout.count(), 0, seconds,
+           stats[OP_TRANSLATE].fanout);
+  printRow("add", stats[OP_ADD].fanout.count(), 0, seconds,
+           stats[OP_ADD].fanout);
+  printf("\nthroughput %.1f operations/s\n", total / seconds);
+}
+
+int
+main(int argc, char **argv)
+{
+  for(int i=1; i<argc; ++i) {
+    if (strcmp(argv[i], "--stats")==0) {
+      showstats = true;
+      continue;
+    }
+    if (i+1>=argc)
+      usage();
+    if (strcmp(argv[i], "--host")==0) {
+      host = argv[++i];
+    } else
+    if (strcmp(argv[i], "--port")==0) {
+      port = atoi(argv[++i]);
+    } else
+    if (strcmp(argv[i], "--clients")==0) {
+      nclients = atoi(argv[++i]);
+    } else
+    if (strcmp(argv[i], "--map")==0) {
+      map_id = atoi(argv[++i]);
+    } else
+    if (strcmp(argv[i], "--nodes")==0) {
+      nnodes = atoi(argv[++i]);
+    } else
+    if (strcmp(argv[i], "--rate")==0) {
+      rate = atof(argv[++i]);
+    } else
+    if (strcmp(argv[i], "--duration")==0) {
+      duration = atoi(argv[++i]);
+    } else
+    if (strcmp(argv[i], "--warmup")==0) {
+      warmup = atoi(argv[++i]);
+    } else
+    if (strcmp(argv[i], "--timeout")==0) {
+      timeout = (TTime)atoi(argv[++i]) * 1000000;
+    } else
+    if (strcmp(argv[i], "--mix")==0) {
+      parseMix(argv[++i]);
+    } else {
+      usage();
+    }
+  }
+  if (nclients==0 || rate<=0.0 || duration==0)
+    usage();
+
+  srand48(time(NULL));
+
+  vector<TBenchClient*> clients;
+  TTime t = now();
+  for(unsigned i=0; i<nclients; ++i) {
+    TBenchClient *c = new TBenchClient(i);
+    if (!c->connect())
+      exit(EXIT_FAILURE);
+    c->next = t + interval();
+    clients.push_back(c);
+  }
+
+  TTime begin = t + (TTime)warmup * 1000000;
+  TTime end   = begin + (TTime)duration * 1000000;
+  TTime purge = t;
+  vector<pollfd> fds(nclients);
+  while(true) {
+    t = now();
+    if (t>=end)
+      break;
+    if (!measuring && t>=begin) {
+      measuring = true;
+      cout << "measuring..." << endl;
+    }
+
+    TTime wakeup = t + 10000;
+    for(unsigned i=0; i<nclients; ++i) {
+      TBenchClient *c = clients[i];
+      c->expire(t);
+      if (c->ready && !c->busy) {
+        // catch up when the scheduled time has already passed
+        while(c->next <= t && !c->busy) {
+          c->start(c->next);
+          c->next += interval();
+        }
+        if (c->next < wakeup)
+          wakeup = c->next;
+      }
+      fds[i].fd = c->fd;
+      fds[i].events = POLLIN;
+      if (!c->out.empty())
+        fds[i].events |= POLLOUT;
+    }
+
+    if (t - purge > 1000000) {
+      for(unsigned i=0; i<OP_MAX; ++i) {
+        TPending::iterator p = pending[i].begin();
+        while(p!=pending[i].end()) {
+          if (t - p->second > timeout)
+            pending[i].erase(p++);
+          else
+            ++p;
+        }
+      }
+      purge = t;
+    }
+
+    int ms = wakeup > t ? (wakeup - t + 999) / 1000 : 0;
+    if (poll(&fds[0], nclients, ms)<0 && errno!=EINTR) {
+      perror("poll");
+      exit(EXIT_FAILURE);
+    }
+    for(unsigned i=0; i<nclients; ++i) {
+      TBenchClient *c = clients[i];
+      if (fds[i].revents & (POLLIN|POLLERR|POLLHUP)) {
+        if (!c->canRead())
+          exit(EXIT_FAILURE);
+      }
+      if (!c->out.empty() && !c->canWrite())
+        exit(EXIT_FAILURE);
+    }
+  }
+
+  measuring = false;
+  report((end - begin) / 1000000.0);
+
+  if (showstats) {
+    TBenchClient *c = clients[0];
+    c->send(frame(CMD_GET_STATS));
+    t = now();
+    while(!gotstats && now() - t < timeout) {
+      pollfd pfd;
+      pfd.fd = c->fd;
+      pfd.events = POLLIN;
+      if (!c->out.empty())
+        pfd.events |= POLLOUT;
+      poll(&pfd, 1, 100);
+      if (!c->canWrite() || !c->canRead())
+        break;
+    }
+  }
+
+  // remove the added symbols, the server doesn't reply to this
+  for(unsigned i=0; i<nclients; ++i) {
+    clients[i]->cleanup();
+    fcntl(clients[i]->fd, F_SETFL, 0);
+    clients[i]->canWrite();
+    delete clients[i];
+  }
+  return 0;
+}
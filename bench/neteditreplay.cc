@@ -0,0 +1,738 @@
+/*
+ * NetEdit -- A network management tool
+ * Copyright (C) 2003-2006 by Mark-André Hopf <mhopf@mark13.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/**
+ * NetEdit Session Replay
+ *
+ * Plays sessions recorded with 'neteditd --record <dir>' back against a
+ * server, each recording over a connection of its own. Sessions start
+ * relative to each other as they did when they were recorded and their
+ * messages are sent at the recorded times, optionally scaled by
+ * --speed. With --fast every session sends its messages as fast as the
+ * server takes them.
+ *
+ * Symbols and connections added during a session get ids from the
+ * server which differ from those in the recording. The replay waits
+ * for the server's CMD_RENAME_SYMBOL/CMD_RENAME_CONNECTION before it
+ * acknowledges them and translates the recorded ids in later messages.
+ * All other ids are sent as recorded, so the database should be in the
+ * state it was when the recording was made.
+ *
+ * Round trip times are measured for commands the server replies to:
+ *
+ *   GET_MAPLIST, OPEN_MAP (until MAP_END), ADD_SYMBOL (until
+ *   RENAME_SYMBOL), ADD_CONNECTION (until RENAME_CONNECTION),
+ *   OPEN_NODE, LOCK_NODE (when granted), HEARTBEAT and GET_STATS
+ *
+ * When replaying at recorded speed they are measured from the time a
+ * message was scheduled, so a server falling behind shows up in the
+ * latencies. 'send lag' is how late messages were actually sent.
+ */
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+
+#include "../lib/common.hh"
+#include "../lib/binary.hh"
+#include "../lib/histogram.hh"
+#include "../lib/session.hh"
+
+using namespace std;
+using namespace netedit;
+
+typedef THistogram::TValue TTime; // microseconds
+
+static TTime
+now()
+{
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (TTime)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+static const unsigned COMMANDS = 64;
+
+struct TCommandStats {
+  TCommandStats() { sent = lost = 0; }
+  unsigned long long sent, lost;
+  THistogram rtt;     // round trip time
+};
+static TCommandStats stats[COMMANDS];
+static THistogram lag;
+static unsigned long long totalbytes = 0;
+
+static const char *host = "127.0.0.1";
+static unsigned port = 15001;
+static bool fast = false;
+static double speed = 1.0;
+static TTime timeout = 5000000;
+
+// don't queue more than this for a connection when replaying with --fast
+static const size_t MAX_QUEUED = 65536;
+
+struct TFrame {
+  TTime time;         // microseconds since the session started
+  string msg;
+};
+
+/**
+ * A recorded session being played back.
+ */
+class TReplaySession
+{
+  public:
+    TReplaySession(const string &filename);
+    ~TReplaySession();
+
+    string filename;
+    string peer;
+    TTime started;        // when the recording started, since the epoch
+    vector<TFrame> frames;
+
+    int fd;
+    string in, out;
+    TTime begin;          // when the replay of this session starts
+    size_t pos;           // next frame to be sent
+    TTime blocked;        // since when the next frame waits for a reply
+    bool finished;
+
+    bool load();
+    bool connect();
+    TTime pump(TTime t);
+    bool canRead();
+    bool canWrite();
+    void expire(TTime t);
+    bool done() const {
+      return pos==frames.size() && out.empty() && pending.empty();
+    }
+
+  protected:
+    typedef pair<int, int> TKey; // map and id
+    typedef map<TKey, int> TIDs;
+    TIDs symbols;         // recorded ids of added symbols to replayed ids
+    TIDs connections;
+    TIDs newsymbols;      // ids assigned by the server, not acknowledged yet
+    TIDs newconnections;
+
+    typedef map<pair<unsigned, long long>, deque<TTime> > TPending;
+    TPending pending;     // send times of requests waiting for a reply
+
+    bool prepare(string *msg, TTime scheduled, TTime t);
+    bool acknowledge(string *msg, TIDs *assigned, TIDs *ids, TTime t);
+    void translate(string *msg, unsigned p, int map, TIDs *ids);
+    void expect(unsigned cmd, long long key, TTime t);
+    void reply(unsigned cmd, long long key, TTime t);
+    void execute();
+};
+
+static long long
+key(int map, int id)
+{
+  return ((long long)map << 32) | (unsigned)id;
+}
+
+TReplaySession::TReplaySession(const string &filename)
+{
+  this->filename = filename;
+  fd = -1;
+  pos = 0;
+  blocked = 0;
+  begin = 0;
+  started = 0;
+  finished = false;
+}
+
+TReplaySession::~TReplaySession()
+{
+  if (fd!=-1)
+    close(fd);
+}
+
+/**
+ * Read the recording.
+ */
+bool
+TReplaySession::load()
+{
+  ifstream file(filename.c_str(), ios::in | ios::binary);
+  if (!file) {
+    cerr << "couldn't open '" << filename << "'" << endl;
+    return false;
+  }
+  ostringstream buffer;
+  buffer << file.rdbuf();
+  string data = buffer.str();
+
+  unsigned p = 0;
+  if (data.size()<20 ||
+      getDWord(data, &p)!=SESSION_MAGIC ||
+      getDWord(data, &p)!=SESSION_VERSION)
+  {
+    cerr << "'" << filename << "' isn't a session recording" << endl;
+    return false;
+  }
+  started = getQWord(data, &p);
+  peer = getString(data, &p);
+
+  while(p+16 <= data.size()) {
+    TFrame frame;
+    frame.time = getQWord(data, &p);
+    unsigned q = p;
+    size_t n = getDWord(data, &q);
+    if (n<8 || p+n > data.size())
+      break;
+    frame.msg = data.substr(p, n);
+    frames.push_back(frame);
+    p += n;
+  }
+  if (p!=data.size())
+    cerr << "'" << filename << "' is truncated after "
+         << frames.size() << " messages" << endl;
+  return true;
+}
+
+bool
+TReplaySession::connect()
+{
+  sockaddr_in name;
+  in_addr ia;
+  if (inet_aton(host, &ia)!=0) {
+    name.sin_addr.s_addr = ia.s_addr;
+  } else {
+    struct hostent *hostinfo;
+    hostinfo = gethostbyname(host);
+    if (hostinfo==0) {
+      cerr << "couldn't resolve hostname '" << host << "'" << endl;
+      return false;
+    }
+    name.sin_addr = *(struct in_addr *) hostinfo->h_addr;
+  }
+  name.sin_family = AF_INET;
+  name.sin_port   = htons(port);
+
+  fd = socket (AF_INET, SOCK_STREAM, 0);
+  if (fd==-1) {
+    perror("failed to create socket");
+    return false;
+  }
+
+  int yes = 1;
+  if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(int))<0) {
+    perror("failed to set TCP_NODELAY");
+  }
+
+  if (::connect(fd, (sockaddr*) &name, sizeof(sockaddr_in)) < 0) {
+    perror("couldn't connect to server");
+    return false;
+  }
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+  return true;
+}
+
+/**
+ * Queue the frames due at time 't' and return the time the next one is
+ * due.
+ */
+TTime
+TReplaySession::pump(TTime t)
+{
+  while(pos < frames.size()) {
+    TTime due = fast ? t : begin + (TTime)(frames[pos].time / speed);
+    if (due > t)
+      return due;
+    if (fast && out.size() >= MAX_QUEUED)
+      break;
+    string msg = frames[pos].msg;
+    if (!prepare(&msg, due, t))
+      break;
+    if (!fast)
+      lag.record(t - due);
+    out += msg;
+    totalbytes += msg.size();
+    ++pos;
+  }
+  // poll again in a while when waiting for a reply or buffer space
+  return t + 10000;
+}
+
+/**
+ * Translate the ids in a message about to be sent and remember when a
+ * reply is expected. Returns false when the message has to wait for a
+ * reply from the server.
+ */
+bool
+TReplaySession::prepare(string *msg, TTime scheduled, TTime t)
+{
+  unsigned p = 4;
+  unsigned cmd = getDWord(*msg, &p);
+  size_t n = msg->size();
+  TTime sent = fast ? t : scheduled;
+
+  switch(cmd) {
+    case CMD_RENAME_SYMBOL:
+      if (n>=20 && !acknowledge(msg, &newsymbols, &symbols, t))
+        return false;
+      break;
+    case CMD_RENAME_CONNECTION:
+      if (n>=20 && !acknowledge(msg, &newconnections, &connections, t))
+        return false;
+      break;
+
+    case CMD_ADD_SYMBOL:
+      if (n>=24) {
+        int map = getSDWord(*msg, &p);
+        expect(CMD_RENAME_SYMBOL, key(map, getSDWord(*msg, &p)), sent);
+      }
+      break;
+    case CMD_DELETE_SYMBOL:
+    case CMD_TRANSLATE_SYMBOL:
+      if (n>=16) {
+        int map = getSDWord(*msg, &p);
+        translate(msg, p, map, &symbols);
+      }
+      break;
+
+    case CMD_ADD_CONNECTION:
+      if (n>=24) {
+        int map = getSDWord(*msg, &p);
+        int conn = getSDWord(*msg, &p);
+        translate(msg, p, map, &symbols);
+        translate(msg, p+4, map, &symbols);
+        expect(CMD_RENAME_CONNECTION, key(map, conn), sent);
+      }
+      break;
+    case CMD_DELETE_CONNECTION:
+      if (n>=16) {
+        int map = getSDWord(*msg, &p);
+        translate(msg, p, map, &connections);
+      }
+      break;
+
+    case CMD_GET_MAPLIST:
+    case CMD_GET_STATS:
+      expect(cmd, 0, sent);
+      break;
+    case CMD_OPEN_MAP:
+      if (n>=12)
+        expect(CMD_MAP_END, getSDWord(*msg, &p), sent);
+      break;
+    case CMD_OPEN_NODE:
+    case CMD_LOCK_NODE:
+      if (n>=12)
+        expect(cmd, getDWord(*msg, &p), sent);
+      break;
+    case CMD_HEARTBEAT:
+      expect(cmd, n>=12 ? getDWord(*msg, &p) : 0, sent);
+      break;
+  }
+  if (cmd < COMMANDS)
+    ++stats[cmd].sent;
+  blocked = 0;
+  return true;
+}
+
+/**
+ * Rewrite the client's acknowledgement of an id assigned by the server,
+ * which the recorded client got from a different server.
+ */
+bool
+TReplaySession::acknowledge(string *msg, TIDs *assigned, TIDs *ids, TTime t)
+{
+  unsigned p = 8;
+  int map = getSDWord(*msg, &p);
+  int tmp = getSDWord(*msg, &p);
+  int recorded = getSDWord(*msg, &p);
+  TIDs::iterator a = assigned->find(TKey(map, tmp));
+  if (a==assigned->end()) {
+    if (!blocked)
+      blocked = t;
+    if (t - blocked < timeout)
+      return false;
+    // the server never assigned an id, send the message as recorded
+    return true;
+  }
+  (*ids)[TKey(map, recorded)] = a->second;
+  setDWord(msg, 16, a->second);
+  assigned->erase(a);
+  return true;
+}
+
+/**
+ * Replace the recorded id at offset 'p' of 'msg' by the one the server
+ * assigned during the replay.
+ */
+void
+TReplaySession::translate(string *msg, unsigned p, int map, TIDs *ids)
+{
+  unsigned q = p;
+  int id = getSDWord(*msg, &q);
+  TIDs::iterator i = ids->find(TKey(map, id));
+  if (i!=ids->end())
+    setDWord(msg, p, i->second);
+}
+
+void
+TReplaySession::expect(unsigned cmd, long long key, TTime t)
+{
+  pending[make_pair(cmd, key)].push_back(t);
+}
+
+/**
+ * The server replied to a request, 'cmd' being the request.
+ */
+void
+TReplaySession::reply(unsigned cmd, long long key, TTime t)
+{
+  unsigned replycmd = cmd;
+  if (cmd==CMD_ADD_SYMBOL)
+    replycmd = CMD_RENAME_SYMBOL;
+  else if (cmd==CMD_ADD_CONNECTION)
+    replycmd = CMD_RENAME_CONNECTION;
+  else if (cmd==CMD_OPEN_MAP)
+    replycmd = CMD_MAP_END;
+
+  TPending::iterator p = pending.find(make_pair(replycmd, key));
+  if (p==pending.end())
+    return;
+  TTime sent = p->second.front();
+  stats[cmd].rtt.record(t > sent ? t - sent : 0);
+  p->second.pop_front();
+  if (p->second.empty())
+    pending.erase(p);
+}
+
+/**
+ * Give up on replies which didn't arrive in time.
+ */
+void
+TReplaySession::expire(TTime t)
+{
+  static const unsigned request[][2] = {
+    { CMD_RENAME_SYMBOL, CMD_ADD_SYMBOL },
+    { CMD_RENAME_CONNECTION, CMD_ADD_CONNECTION },
+    { CMD_MAP_END, CMD_OPEN_MAP }
+  };
+  TPending::iterator p = pending.begin();
+  while(p!=pending.end()) {
+    deque<TTime> &q = p->second;
+    while(!q.empty() && t > q.front() && t - q.front() > timeout) {
+      unsigned cmd = p->first.first;
+      for(unsigned i=0; i<3; ++i) {
+        if (request[i][0]==cmd)
+          cmd = request[i][1];
+      }
+      ++stats[cmd].lost;
+      q.pop_front();
+    }
+    if (q.empty())
+      pending.erase(p++);
+    else
+      ++p;
+  }
+}
+
+bool
+TReplaySession::canWrite()
+{
+  while(!out.empty()) {
+    ssize_t n = write(fd, out.c_str(), out.size());
+    if (n<0) {
+      if (errno==EINTR)
+        continue;
+      if (errno==EAGAIN)
+        break;
+      perror("error when writing to server");
+      return false;
+    }
+    out.erase(0, n);
+  }
+  return true;
+}
+
+bool
+TReplaySession::canRead()
+{
+  while(true) {
+    char cbuffer[65536];
+    ssize_t n = read(fd, cbuffer, sizeof(cbuffer));
+    if (n==0) {
+      cerr << filename << ": lost connection to server" << endl;
+      return false;
+    }
+    if (n<0) {
+      if (errno==EINTR)
+        continue;
+      if (errno==EAGAIN)
+        break;
+      perror("error when reading from server");
+      return false;
+    }
+    in.append(cbuffer, n);
+  }
+  execute();
+  return true;
+}
+
+void
+TReplaySession::execute()
+{
+  TTime t = now();
+  while(in.size()>=8) {
+    unsigned p = 0;
+    size_t n = getDWord(in, &p);
+    if (n<8) {
+      cerr << filename << ": received malformed message" << endl;
+      in.clear();
+      break;
+    }
+    if (in.size() < n)
+      break;
+    unsigned cmd = getDWord(in, &p);
+    switch(cmd) {
+      case CMD_RENAME_SYMBOL:
+      case CMD_RENAME_CONNECTION: {
+        int map    = getSDWord(in, &p);
+        int old_id = getSDWord(in, &p);
+        int new_id = getSDWord(in, &p);
+        if (cmd==CMD_RENAME_SYMBOL) {
+          newsymbols[TKey(map, old_id)] = new_id;
+          reply(CMD_ADD_SYMBOL, key(map, old_id), t);
+        } else {
+          newconnections[TKey(map, old_id)] = new_id;
+          reply(CMD_ADD_CONNECTION, key(map, old_id), t);
+        }
+      } break;
+
+      case CMD_MAP_END:
+        reply(CMD_OPEN_MAP, getSDWord(in, &p), t);
+        break;
+      case CMD_GET_MAPLIST:
+      case CMD_GET_STATS:
+        reply(cmd, 0, t);
+        break;
+      case CMD_OPEN_NODE:
+        reply(cmd, getDWord(in, &p), t);
+        break;
+      case CMD_LOCK_NODE: {
+        int node = getDWord(in, &p);
+        // a denied lock isn't answered, others are told about ours
+        if (getByte(in, &p)==NODE_LOCKED_LOCAL)
+          reply(cmd, node, t);
+      } break;
+      case CMD_HEARTBEAT:
+        reply(cmd, n>=12 ? getDWord(in, &p) : 0, t);
+        break;
+    }
+    in.erase(0, n);
+  }
+}
+
+static void
+usage()
+{
+  fprintf(stderr,
+    "usage: neteditreplay [options] <recording>...\n"
+    "  --host <host>        server to connect to (127.0.0.1)\n"
+    "  --port <port>        port of the server (15001)\n"
+    "  --speed <factor>     replay faster (>1) or slower (<1) than recorded (1)\n"
+    "  --fast               send every message as soon as possible\n"
+    "  --timeout <sec>      time to wait for a reply (5)\n");
+  exit(EXIT_FAILURE);
+}
+
+static void
+printRow(const char *name, unsigned long long count, unsigned long long lost,
+         double seconds, const THistogram &h)
+{
+  printf("%-18s %9llu %7llu %9.1f", name, count, lost, count / seconds);
+  if (h.count()==0) {
+    printf("        -        -        -        -\n");
+    return;
+  }
+  printf(" %8.3f %8.3f %8.3f %8.3f\n",
+    h.percentile(50.0) / 1000.0,
+    h.percentile(99.0) / 1000.0,
+    h.percentile(99.9) / 1000.0,
+    h.max() / 1000.0);
+}
+
+static void
+report(unsigned sessions, double seconds)
+{
+  unsigned long long total = 0;
+  for(unsigned i=0; i<COMMANDS; ++i)
+    total += stats[i].sent;
+
+  printf("\n%u sessions, %s, %.3fs\n\n", sessions,
+         fast ? "as fast as possible" : "at recorded times", seconds);
+  printf("%-18s %9s %7s %9s %8s %8s %8s %8s\n", "command",
+         "sent", "lost", "msgs/s", "p50 ms", "p99 ms", "p999 ms", "max ms");
+  for(unsigned i=0; i<COMMANDS; ++i) {
+    const TCommandStats &s = stats[i];
+    if (s.sent)
+      printRow(commandName(i), s.sent, s.lost, seconds, s.rtt);
+  }
+  if (!fast) {
+    printf("\n");
+    printRow("send lag", lag.count(), 0, seconds, lag);
+  }
+  printf("\nthroughput %.1f messages/s, %.1f KB/s\n",
+         total / seconds, totalbytes / seconds / 1024.0);
+}
+
+int
+main(int argc, char **argv)
+{
+  vector<TReplaySession*> sessions;
+  for(int i=1; i<argc; ++i) {
+    if (argv[i][0]!='-') {
+      sessions.push_back(new TReplaySession(argv[i]));
+      continue;
+    }
+    if (strcmp(argv[i], "--fast")==0) {
+      fast = true;
+      continue;
+    }
+    if (i+1>=argc)
+      usage();
+    if (strcmp(argv[i], "--host")==0) {
+      host = argv[++i];
+    } else
+    if (strcmp(argv[i], "--port")==0) {
+      port = atoi(argv[++i]);
+    } else
+    if (strcmp(argv[i], "--speed")==0) {
+      speed = atof(argv[++i]);
+    } else
+    if (strcmp(argv[i], "--timeout")==0) {
+      timeout = (TTime)atoi(argv[++i]) * 1000000;
+    } else {
+      usage();
+    }
+  }
+  if (sessions.empty() || speed<=0.0)
+    usage();
+
+  TTime first = 0;
+  for(unsigned i=0; i<sessions.size(); ++i) {
+    if (!sessions[i]->load())
+      exit(EXIT_FAILURE);
+    if (i==0 || sessions[i]->started < first)
+      first = sessions[i]->started;
+  }
+
+  TTime start = now();
+  for(unsigned i=0; i<sessions.size(); ++i) {
+    TReplaySession *s = sessions[i];
+    if (!fast)
+      s->begin = start + (TTime)((s->started - first) / speed);
+  }
+
+  // sessions are connected when their first message is due
+  vector<TReplaySession*> active;
+  vector<pollfd> fds;
+  size_t waiting = sessions.size();
+  while(waiting || !active.empty()) {
+    TTime t = now();
+    TTime wakeup = t + 10000;
+
+    for(unsigned i=0; i<sessions.size(); ++i) {
+      TReplaySession *s = sessions[i];
+      if (s->fd!=-1 || s->finished)
+        continue;
+      if (s->begin > t) {
+        if (s->begin < wakeup)
+          wakeup = s->begin;
+        continue;
+      }
+      if (!s->connect())
+        exit(EXIT_FAILURE);
+      if (fast)
+        s->begin = t;
+      active.push_back(s);
+      --waiting;
+    }
+
+    fds.resize(active.size());
+    for(unsigned i=0; i<active.size(); ++i) {
+      TReplaySession *s = active[i];
+      s->expire(t);
+      TTime next = s->pump(t);
+      if (next < wakeup)
+        wakeup = next;
+      fds[i].fd = s->fd;
+      fds[i].events = POLLIN;
+      if (!s->out.empty())
+        fds[i].events |= POLLOUT;
+    }
+
+    int ms = wakeup > t ? (wakeup - t + 999) / 1000 : 0;
+    if (poll(fds.empty() ? NULL : &fds[0], fds.size(), ms)<0 &&
+        errno!=EINTR)
+    {
+      perror("poll");
+      exit(EXIT_FAILURE);
+    }
+    for(unsigned i=0; i<active.size(); ++i) {
+      TReplaySession *s = active[i];
+      if (fds[i].revents & (POLLIN|POLLERR|POLLHUP)) {
+        if (!s->canRead())
+          exit(EXIT_FAILURE);
+      }
+      if (!s->out.empty() && !s->canWrite())
+        exit(EXIT_FAILURE);
+    }
+
+    // a finished session disconnects like the recorded client did
+    for(unsigned i=active.size(); i>0; --i) {
+      TReplaySession *s = active[i-1];
+      if (s->done()) {
+        close(s->fd);
+        s->fd = -1;
+        s->finished = true;
+        active.erase(active.begin() + i - 1);
+      }
+    }
+  }
+
+  report(sessions.size(), (now() - start) / 1000000.0);
+
+  for(unsigned i=0; i<sessions.size(); ++i)
+    delete sessions[i];
+  return 0;
+}
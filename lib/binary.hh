@@ -18,10 +18,12 @@
  */
 
 #ifndef __NETEDIT_BINARY_HH
-
-namespace netedit {
+#define __NETEDIT_BINARY_HH
 
 #include <string>
+#include <string.h>
+
+namespace netedit {
 
 using namespace std;
 
@@ -72,6 +74,19 @@ getDWord(const string &s, unsigned *p)
   return n;
 }
 
+inline void
+addQWord(string *s, unsigned long long n) {
+  addDWord(s, n >> 32);
+  addDWord(s, n & 0xFFFFFFFF);
+}
+
+inline unsigned long long
+getQWord(const string &s, unsigned *p)
+{
+  unsigned long long n = getDWord(s, p);
+  return (n << 32) | getDWord(s, p);
+}
+
 inline void
 addSDWord(string *s, int n) {
   unsigned m;
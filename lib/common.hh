@@ -47,9 +47,58 @@ enum {
   CMD_SET_NODE,
   CMD_UPDATE_NODE,
   CMD_LOCK_NODE,
-  CMD_UNLOCK_NODE
+  CMD_UNLOCK_NODE,
+
+  CMD_QUERY_REGION,
+
+  CMD_MAP_SYMBOLS,
+  CMD_MAP_CONNECTIONS,
+  CMD_MAP_END,
+
+  CMD_HEARTBEAT,
+  CMD_GET_STATS
 };
 
+/**
+ * The name of a command for diagnostics.
+ */
+inline const char*
+commandName(unsigned cmd)
+{
+  switch(cmd) {
+    case CMD_LOGIN: return "LOGIN";
+    case CMD_GET_MAPLIST: return "GET_MAPLIST";
+    case CMD_OPEN_MAP: return "OPEN_MAP";
+    case CMD_CLOSE_MAP: return "CLOSE_MAP";
+    case CMD_ADD_MAP: return "ADD_MAP";
+    case CMD_RENAME_MAP: return "RENAME_MAP";
+    case CMD_DELETE_MAP: return "DELETE_MAP";
+    case CMD_ADD_SYMBOL: return "ADD_SYMBOL";
+    case CMD_RENAME_SYMBOL: return "RENAME_SYMBOL";
+    case CMD_DELETE_SYMBOL: return "DELETE_SYMBOL";
+    case CMD_TRANSLATE_SYMBOL: return "TRANSLATE_SYMBOL";
+    case CMD_ADD_CONNECTION: return "ADD_CONNECTION";
+    case CMD_RENAME_CONNECTION: return "RENAME_CONNECTION";
+    case CMD_DELETE_CONNECTION: return "DELETE_CONNECTION";
+    case CMD_EDIT_CONNECTION: return "EDIT_CONNECTION";
+    case CMD_ADD_NODE: return "ADD_NODE";
+    case CMD_DELETE_NODE: return "DELETE_NODE";
+    case CMD_OPEN_NODE: return "OPEN_NODE";
+    case CMD_CLOSE_NODE: return "CLOSE_NODE";
+    case CMD_SET_NODE: return "SET_NODE";
+    case CMD_UPDATE_NODE: return "UPDATE_NODE";
+    case CMD_LOCK_NODE: return "LOCK_NODE";
+    case CMD_UNLOCK_NODE: return "UNLOCK_NODE";
+    case CMD_QUERY_REGION: return "QUERY_REGION";
+    case CMD_MAP_SYMBOLS: return "MAP_SYMBOLS";
+    case CMD_MAP_CONNECTIONS: return "MAP_CONNECTIONS";
+    case CMD_MAP_END: return "MAP_END";
+    case CMD_HEARTBEAT: return "HEARTBEAT";
+    case CMD_GET_STATS: return "GET_STATS";
+  }
+  return "UNKNOWN";
+}
+
 enum {
   NODE_UNLOCKED,
   NODE_LOCKED_LOCAL,
@@ -0,0 +1,141 @@
+/*
+ * NetEdit -- A network management tool
+ * Copyright (C) 2003-2006 by Mark-André Hopf <mhopf@mark13.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __NETEDIT_HISTOGRAM_HH
+#define __NETEDIT_HISTOGRAM_HH
+
+#include <vector>
+
+namespace netedit {
+
+using namespace std;
+
+/**
+ * A log-linear histogram of unsigned values, usually latencies in
+ * microseconds.
+ *
+ * Values below 128 are counted exactly, larger values in 64 buckets per
+ * power of two, which keeps the relative error of a reported value below
+ * 1.6% over the whole 64 bit range.
+ * Recording is O(1) and the memory used grows with the largest value
+ * recorded (about 14KB for values up to one hour in microseconds).
+ */
+class THistogram
+{
+  public:
+    typedef unsigned long long TValue;
+
+  private:
+    static const unsigned SUB_BITS = 7;
+    static const unsigned SUB      = 1 << SUB_BITS;
+    static const unsigned HALF     = SUB / 2;
+
+    vector<TValue> buckets;
+    TValue total;
+    TValue lowest, highest;
+    double sum;
+
+    static unsigned index(TValue v) {
+      if (v < SUB)
+        return v;
+      unsigned shift = 63 - __builtin_clzll(v) - (SUB_BITS-1);
+      return SUB + (shift-1) * HALF + ((v >> shift) - HALF);
+    }
+
+    // the highest value counted in bucket 'i'
+    static TValue value(unsigned i) {
+      if (i < SUB)
+        return i;
+      unsigned shift = (i - SUB) / HALF + 1;
+      TValue m = (i - SUB) % HALF + HALF;
+      return ((m+1) << shift) - 1;
+    }
+
+  public:
+    THistogram() {
+      clear();
+    }
+
+    void clear() {
+      buckets.clear();
+      total = 0;
+      lowest = highest = 0;
+      sum = 0.0;
+    }
+
+    void record(TValue v, TValue n = 1) {
+      unsigned i = index(v);
+      if (i >= buckets.size())
+        buckets.resize(i+1);
+      buckets[i] += n;
+      if (total==0 || v<lowest)
+        lowest = v;
+      if (v>highest)
+        highest = v;
+      total += n;
+      sum += (double)v * n;
+    }
+
+    void merge(const THistogram &h) {
+      if (h.total==0)
+        return;
+      if (h.buckets.size() > buckets.size())
+        buckets.resize(h.buckets.size());
+      for(unsigned i=0; i<h.buckets.size(); ++i)
+        buckets[i] += h.buckets[i];
+      if (total==0 || h.lowest<lowest)
+        lowest = h.lowest;
+      if (h.highest>highest)
+        highest = h.highest;
+      total += h.total;
+      sum += h.sum;
+    }
+
+    TValue count() const { return total; }
+    TValue min() const { return lowest; }
+    TValue max() const { return highest; }
+    double mean() const { return total ? sum / total : 0.0; }
+
+    /**
+     * The value below or at which 'p' percent of all recorded values
+     * are, e.g. percentile(99.9).
+     */
+    TValue percentile(double p) const {
+      if (total==0)
+        return 0;
+      TValue rank = (TValue)(p / 100.0 * total + 0.5);
+      if (rank<1)
+        rank = 1;
+      if (rank>=total)
+        return highest;
+      TValue n = 0;
+      for(unsigned i=0; i<buckets.size(); ++i) {
+        n += buckets[i];
+        if (n>=rank) {
+          TValue v = value(i);
+          return v<highest ? v : highest;
+        }
+      }
+      return highest;
+    }
+};
+
+} // namespace netedit
+
+#endif
@@ -0,0 +1,343 @@
+/*
+ * NetEdit -- A network management tool
+ * Copyright (C) 2003-2006 by Mark-André Hopf <mhopf@mark13.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __NETEDIT_LOG_HH
+#define __NETEDIT_LOG_HH
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+#include <string>
+
+/**
+ * An asynchronous, leveled logger.
+ *
+ *   LOG_WARN("client tried to lock node " << node_id << " twice");
+ *
+ * Messages are formatted into a fixed size buffer on the caller's stack
+ * and handed over to a background thread through a bounded lock-free
+ * ring (Dmitry Vyukov's bounded queue), which writes them to stdout.
+ * Callers never wait for I/O; when the ring is full the message is
+ * dropped and counted instead. The writer sleeps on a condition
+ * variable while the ring is empty and callers only take its mutex to
+ * wake it up.
+ *
+ * Messages above LOG_LEVEL are removed at compile time, the remaining
+ * ones are filtered at runtime with TLog::setLevel().
+ */
+
+#define LOG_LEVEL_ERROR 0
+#define LOG_LEVEL_WARN  1
+#define LOG_LEVEL_INFO  2
+#define LOG_LEVEL_DEBUG 3
+#define LOG_LEVEL_TRACE 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_TRACE
+#endif
+
+#define LOG_AT(lvl, expr) \
+  do { \
+    if ((lvl) <= LOG_LEVEL && ::netedit::TLog::enabled(lvl)) { \
+      ::netedit::TLogLine _logline(lvl); \
+      _logline << expr; \
+      _logline.commit(); \
+    } \
+  } while(0)
+
+#define LOG_ERROR(expr) LOG_AT(LOG_LEVEL_ERROR, expr)
+#define LOG_WARN(expr)  LOG_AT(LOG_LEVEL_WARN,  expr)
+#define LOG_INFO(expr)  LOG_AT(LOG_LEVEL_INFO,  expr)
+#define LOG_DEBUG(expr) LOG_AT(LOG_LEVEL_DEBUG, expr)
+#define LOG_TRACE(expr) LOG_AT(LOG_LEVEL_TRACE, expr)
+
+namespace netedit {
+
+class TLog
+{
+  public:
+    static const unsigned SLOTS = 4096;   // must be a power of two
+    static const unsigned LINE  = 240;    // longer messages are truncated
+
+    static TLog& instance() {
+      // never destroyed, so logging stays possible during exit
+      static TLog *log = new TLog;
+      return *log;
+    }
+
+    static bool enabled(int level) {
+      return level <= instance().level;
+    }
+    static void setLevel(int level) {
+      instance().level = level;
+    }
+
+    void push(int level, const char *text, unsigned len);
+    void flush();
+    void write(const std::string &text);
+
+  private:
+    struct TSlot {
+      size_t seq;
+      int level;
+      timespec time;
+      unsigned len;
+      char text[LINE];
+    };
+
+    TSlot slot[SLOTS];
+    size_t head;              // next slot to be claimed by a producer
+    size_t tail;              // next slot to be written by the writer
+    unsigned long dropped;
+    int level;
+    bool running;
+    pthread_t writer;
+    pthread_mutex_t output;   // serializes the writer and flush()
+    pthread_mutex_t wake;     // protects waiting for 'idle'
+    pthread_cond_t idle;
+    int sleeping;             // the writer waits or is about to
+
+    TLog();
+    bool ready() const;
+    bool pop();
+    static void* run(void*);
+    static void atexit();
+};
+
+inline
+TLog::TLog()
+{
+  for(size_t i=0; i<SLOTS; ++i)
+    slot[i].seq = i;
+  head = tail = 0;
+  dropped = 0;
+  level = LOG_LEVEL_INFO;
+  sleeping = 0;
+  pthread_mutex_init(&output, NULL);
+  pthread_mutex_init(&wake, NULL);
+  pthread_cond_init(&idle, NULL);
+  running = pthread_create(&writer, NULL, run, this)==0;
+  ::atexit(TLog::atexit);
+}
+
+/**
+ * Enqueue a message, drop it when the ring is full.
+ */
+inline void
+TLog::push(int level, const char *text, unsigned len)
+{
+  TSlot *s;
+  size_t pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+  while(true) {
+    s = &slot[pos & (SLOTS-1)];
+    size_t seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+    intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+    if (dif==0) {
+      if (__atomic_compare_exchange_n(&head, &pos, pos+1, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        break;
+    } else if (dif<0) {
+      __atomic_add_fetch(&dropped, 1, __ATOMIC_RELAXED);
+      return;
+    } else {
+      pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+    }
+  }
+  s->level = level;
+  clock_gettime(CLOCK_REALTIME, &s->time);
+  s->len = len < LINE ? len : LINE;
+  memcpy(s->text, text, s->len);
+  __atomic_store_n(&s->seq, pos+1, __ATOMIC_RELEASE);
+  if (!running) {
+    flush();
+    return;
+  }
+
+  // pairs with the fence in run(): either the writer sees the message
+  // or we see it sleeping
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&sleeping, __ATOMIC_RELAXED)) {
+    pthread_mutex_lock(&wake);
+    pthread_cond_signal(&idle);
+    pthread_mutex_unlock(&wake);
+  }
+}
+
+/**
+ * Return true when the next message can be written.
+ */
+inline bool
+TLog::ready() const
+{
+  const TSlot *s = &slot[__atomic_load_n(&tail, __ATOMIC_RELAXED) & (SLOTS-1)];
+  return __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) ==
+         __atomic_load_n(&tail, __ATOMIC_RELAXED)+1;
+}
+
+/**
+ * Write the next message, return false when there was none. Must be
+ * called with 'output' locked.
+ */
+inline bool
+TLog::pop()
+{
+  TSlot *s = &slot[tail & (SLOTS-1)];
+  if (__atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) != tail+1)
+    return false;
+
+  static const char letter[] = "EWIDT";
+  tm t;
+  localtime_r(&s->time.tv_sec, &t);
+  fprintf(stdout, "%02d:%02d:%02d.%03ld %c ",
+          t.tm_hour, t.tm_min, t.tm_sec, s->time.tv_nsec / 1000000,
+          letter[s->level < 5 ? s->level : 4]);
+  fwrite(s->text, 1, s->len, stdout);
+  fputc('\n', stdout);
+
+  __atomic_store_n(&s->seq, tail + SLOTS, __ATOMIC_RELEASE);
+  ++tail;
+  return true;
+}
+
+/**
+ * Write all pending messages.
+ */
+inline void
+TLog::flush()
+{
+  pthread_mutex_lock(&output);
+  bool wrote = false;
+  while(pop())
+    wrote = true;
+  unsigned long n = __atomic_exchange_n(&dropped, 0, __ATOMIC_RELAXED);
+  if (n) {
+    fprintf(stdout, "%lu log messages dropped\n", n);
+    wrote = true;
+  }
+  if (wrote)
+    fflush(stdout);
+  pthread_mutex_unlock(&output);
+}
+
+/**
+ * Write a report spanning several lines in one piece, after the
+ * pending messages and without interleaving with the writer.
+ */
+inline void
+TLog::write(const std::string &text)
+{
+  pthread_mutex_lock(&output);
+  while(pop())
+    ;
+  fwrite(text.data(), 1, text.size(), stdout);
+  fflush(stdout);
+  pthread_mutex_unlock(&output);
+}
+
+inline void*
+TLog::run(void *data)
+{
+  TLog *log = static_cast<TLog*>(data);
+  while(true) {
+    log->flush();
+
+    pthread_mutex_lock(&log->wake);
+    __atomic_store_n(&log->sleeping, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (!log->ready()) {
+      // wake up once a second anyway to report dropped messages
+      timespec t;
+      clock_gettime(CLOCK_REALTIME, &t);
+      t.tv_sec += 1;
+      pthread_cond_timedwait(&log->idle, &log->wake, &t);
+    }
+    __atomic_store_n(&log->sleeping, 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&log->wake);
+  }
+  return 0;
+}
+
+inline void
+TLog::atexit()
+{
+  instance().flush();
+}
+
+/**
+ * A message being formatted, used by the LOG_* macros.
+ */
+class TLogLine
+{
+    int level;
+    unsigned len;
+    char text[TLog::LINE];
+
+    void append(const char *s, size_t n) {
+      if (n > TLog::LINE - len)
+        n = TLog::LINE - len;
+      memcpy(text+len, s, n);
+      len += n;
+    }
+    template <class T>
+    TLogLine& format(const char *fmt, T v) {
+      char buffer[32];
+      int n = snprintf(buffer, sizeof(buffer), fmt, v);
+      append(buffer, n);
+      return *this;
+    }
+
+  public:
+    TLogLine(int level) {
+      this->level = level;
+      len = 0;
+    }
+
+    TLogLine& operator<<(const char *s) {
+      append(s, strlen(s));
+      return *this;
+    }
+    TLogLine& operator<<(const std::string &s) {
+      append(s.c_str(), s.size());
+      return *this;
+    }
+    TLogLine& operator<<(char c) { append(&c, 1); return *this; }
+    TLogLine& operator<<(bool v) { return *this << (v ? "true" : "false"); }
+    TLogLine& operator<<(int v) { return format("%d", v); }
+    TLogLine& operator<<(unsigned v) { return format("%u", v); }
+    TLogLine& operator<<(long v) { return format("%ld", v); }
+    TLogLine& operator<<(unsigned long v) { return format("%lu", v); }
+    TLogLine& operator<<(long long v) { return format("%lld", v); }
+    TLogLine& operator<<(unsigned long long v) { return format("%llu", v); }
+    TLogLine& operator<<(double v) { return format("%g", v); }
+    TLogLine& operator<<(const void *v) { return format("%p", v); }
+
+    void commit() {
+      // the writer adds the newline
+      while(len>0 && text[len-1]=='\n')
+        --len;
+      TLog::instance().push(level, text, len);
+    }
+};
+
+} // namespace netedit
+
+#endif
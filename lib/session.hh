@@ -0,0 +1,45 @@
+/*
+ * NetEdit -- A network management tool
+ * Copyright (C) 2003-2006 by Mark-André Hopf <mhopf@mark13.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __NETEDIT_SESSION_HH
+#define __NETEDIT_SESSION_HH
+
+/**
+ * Session recordings as written by 'neteditd --record' and read by
+ * neteditreplay.
+ *
+ * A recording holds the messages a single client sent to the server,
+ * all numbers in network byte order as in the protocol itself:
+ *
+ *   dword SESSION_MAGIC, dword SESSION_VERSION,
+ *   qword time the session started in microseconds since the epoch,
+ *   string address of the client
+ *
+ * followed by one record per message until the end of the file:
+ *
+ *   qword microseconds since the session started,
+ *   the message as received, starting with its dword size
+ *
+ * Passwords in CMD_LOGIN are replaced by an empty string.
+ */
+
+#define SESSION_MAGIC   0x4e455352   // "NESR"
+#define SESSION_VERSION 1
+
+#endif
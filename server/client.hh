@@ -18,14 +18,72 @@
  */
 
 #ifndef __NETEDITD_CLIENT_HH
+#define __NETEDITD_CLIENT_HH
 
 #include "idmapping.hh"
+#include "memory.hh"
 #include <string>
+#include <deque>
+#include <climits>
+#include <list>
+#include <set>
+
+class TNode;
 
 namespace netedit {
 
 using namespace std;
 
+class TSessionRecorder;
+
+/**
+ * The state of a map being streamed to a client.
+ *
+ * Maps are sent in pages which are created on demand when the client's
+ * output queue runs empty, so neither side has to hold the whole map in
+ * a single message. Symbols and connections are sent in ascending order
+ * of their ids, 'next' is the smallest id not sent yet.
+ *
+ * A client which still holds a copy of the map from an earlier visit
+ * passes its version along. When the map hasn't changed since, only the
+ * header and CMD_MAP_END are sent. The same is sent for an empty map
+ * when the map couldn't be loaded.
+ */
+struct TMapTransfer
+{
+  enum EPhase {
+    HEADER,
+    SYMBOLS,
+    CONNECTIONS,
+    END,
+    DONE
+  };
+  TMapTransfer(int map_id) {
+    this->map_id = map_id;
+    phase = HEADER;
+    next = INT_MIN;
+    cached = false;
+    refused = false;
+    epoch = version = 0;
+  }
+  int map_id;
+  EPhase phase;
+  int next;
+  bool cached;             // the client has a copy of the map...
+  unsigned epoch, version; // ...in this version
+  bool refused;            // the map couldn't be loaded
+};
+
+/**
+ * Outbound messages are queued in one of two lanes. Control messages
+ * (locks, node and map updates) are always written before bulk data
+ * (map transfers, map lists), which is written in bounded slices.
+ */
+enum EPriority {
+  PRIORITY_CONTROL,
+  PRIORITY_BULK
+};
+
 /**
  * Each client is handled by an object of type TClient.
  */
@@ -35,20 +93,46 @@ class TClient
     TIDMapping symmapping;
     TIDMapping connmapping;
 
+    deque<string> outqueue[2]; // messages waiting to be written
+    int outlane;               // lane of the message being written or -1
+    size_t outpos;             // bytes of that message already written
+    size_t outbytes;           // bytes of all messages in the queues
+
+    typedef list<TMapTransfer> TTransfers;
+    TTransfers transfers;    // maps being streamed to the client
+
   public:
     string login;    // login name of the user as in DBMS
     string hostname; // hostname or IP (+port) from which the user connected
     int fd;
+    set< ::TNode*> locks; // nodes locked by this client
+    TSessionRecorder *recorder; // records the session for --record or NULL
 
     TClient(int fd) {
       this->fd = fd;
+      outlane = -1;
+      outpos = 0;
+      outbytes = 0;
+      recorder = 0;
     }
     ~TClient();
     bool handle();
     void execute();
+
+    void send(const string &msg, EPriority priority = PRIORITY_CONTROL);
+    bool flush();
+    bool wantsWrite() const {
+      return !outqueue[PRIORITY_CONTROL].empty() ||
+             !outqueue[PRIORITY_BULK].empty() ||
+             !transfers.empty();
+    }
+    void queued(size_t *messages, size_t *bytes) const;
+    TClientMemory memory() const;
+    bool pendingSymbol(int map_id, int symbol_id) const;
+    bool pendingConnection(int map_id, int conn_id) const;
     
     void sendMapList();
-    void sendMap(int map_id);
+    void sendMap(const TMapTransfer &transfer);
     void dropMap(int map_id);
 
     void openNode(int node_id);
@@ -56,6 +140,7 @@ class TClient
     void closeNode(int node_id);
     void lockNode(int node_id);
     void unlockNode(int node_id);
+    void heartbeat();
 };
 
 } // namespace netedit
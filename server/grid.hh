@@ -0,0 +1,136 @@
+/*
+ * NetEdit -- A network management tool
+ * Copyright (C) 2003-2006 by Mark-André Hopf <mhopf@mark13.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __NETEDITD_GRID_HH
+#define __NETEDITD_GRID_HH
+
+#include <map>
+#include <vector>
+
+namespace netedit {
+
+using namespace std;
+
+/**
+ * A uniform grid over objects with integer members 'x' and 'y'.
+ *
+ * Only occupied cells are stored, ordered by row and column, so that
+ * a region query only visits the occupied cells within the region no
+ * matter how large the region or how sparse the map is.
+ */
+template <class T>
+class GGrid
+{
+    typedef pair<int, int> TCell; // (row, column)
+    typedef vector<T*> TCellContent;
+    typedef map<TCell, TCellContent> TCells;
+    TCells cells;
+    int cellsize;
+
+    int cell(long long v) const {
+      return v>=0 ? v/cellsize : -((-(v+1))/cellsize)-1;
+    }
+
+  public:
+    GGrid(int cellsize = 256) {
+      this->cellsize = cellsize;
+    }
+
+    void insert(T *e) {
+      cells[TCell(cell(e->y), cell(e->x))].push_back(e);
+    }
+
+    /**
+     * Remove an object which is (still) located at x, y.
+     */
+    void erase(T *e, int x, int y) {
+      typename TCells::iterator p = cells.find(TCell(cell(y), cell(x)));
+      if (p==cells.end())
+        return;
+      for(typename TCellContent::iterator q = p->second.begin();
+          q != p->second.end();
+          ++q)
+      {
+        if (*q==e) {
+          *q = p->second.back();
+          p->second.pop_back();
+          break;
+        }
+      }
+      if (p->second.empty())
+        cells.erase(p);
+    }
+
+    void erase(T *e) {
+      erase(e, e->x, e->y);
+    }
+
+    /**
+     * Update the grid after the object was moved away from ox, oy.
+     */
+    void move(T *e, int ox, int oy) {
+      if (cell(ox)==cell(e->x) && cell(oy)==cell(e->y))
+        return;
+      erase(e, ox, oy);
+      insert(e);
+    }
+
+    void clear() {
+      cells.clear();
+    }
+
+    /**
+     * Append all objects within the rectangle x, y, w, h to 'result'.
+     */
+    void find(int x, int y, int w, int h, vector<T*> *result) const {
+      if (w<=0 || h<=0)
+        return;
+      long long x1 = (long long)x+w, y1 = (long long)y+h;
+      int c0 = cell(x), c1 = cell(x1-1);
+      int r0 = cell(y), r1 = cell(y1-1);
+      typename TCells::const_iterator p = cells.lower_bound(TCell(r0, c0));
+      while(p!=cells.end() && p->first.first <= r1) {
+        if (p->first.second < c0) {
+          p = cells.lower_bound(TCell(p->first.first, c0));
+          continue;
+        }
+        if (p->first.second > c1) {
+          if (p->first.first == r1)
+            break;
+          p = cells.lower_bound(TCell(p->first.first+1, c0));
+          continue;
+        }
+        for(typename TCellContent::const_iterator q = p->second.begin();
+            q != p->second.end();
+            ++q)
+        {
+          if ((*q)->x >= x && (*q)->x < x1 &&
+              (*q)->y >= y && (*q)->y < y1)
+          {
+            result->push_back(*q);
+          }
+        }
+        ++p;
+      }
+    }
+};
+
+} // namespace netedit
+
+#endif
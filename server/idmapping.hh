@@ -20,7 +20,7 @@
 #ifndef __NETEDITD_IDMAPPING_HH
 
 #include <map>
-#include <iostream>
+#include "../lib/log.hh"
 
 namespace netedit {
 
@@ -34,6 +34,9 @@ class TIDMapping
     typedef map<int,int> data_t;
     data_t data;
   public:
+    typedef data_t::value_type value_type;
+    size_t size() const { return data.size(); }
+
     /**
      * Add a new mapping. 
      * \param map
@@ -45,11 +48,11 @@ class TIDMapping
      */
     void insert(int map, int old_id, int new_id) {
       if (old_id>=0) {
-        cout << "warning: attempt to map non-temporary id" << endl;
+        LOG_WARN("attempt to map non-temporary id");
         return;
       }
       if (data.find(old_id)!=data.end()) {
-        cout << "warning: attempt to override id " << old_id << endl;
+        LOG_WARN("attempt to override id " << old_id);
         return;
       }
       data[old_id] = new_id;
@@ -62,11 +65,11 @@ class TIDMapping
       data_t::iterator p;
       p = data.find(old_id);
       if (p==data.end()) {
-        cout << "warning: attempt to erase non-existent id " << old_id << endl;
+        LOG_WARN("attempt to erase non-existent id " << old_id);
         return;
       }
       if (p->second != new_id) {
-        cout << "warning: attempt to erase wrong mapping for id " << old_id << endl;
+        LOG_WARN("attempt to erase wrong mapping for id " << old_id);
         return;
       }
       data.erase(p);
@@ -80,7 +83,7 @@ class TIDMapping
         return old_id;
       data_t::iterator p = data.find(old_id);
       if (p==data.end()) {
-        cout << "warning: attempt to locate non-existent id " << old_id << endl;
+        LOG_WARN("attempt to locate non-existent id " << old_id);
         return old_id;
       }
       return p->second;
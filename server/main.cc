@@ -32,6 +32,7 @@
 #include <sys/select.h>
 
 #include <iostream>
+#include <sstream>
 #include <string>
 #include <vector>
 #include <map>
@@ -41,10 +42,17 @@
 #include "../lib/binary.hh"
 
 #include "map.hh"
+#include "timerwheel.hh"
+#include "stats.hh"
+#include "metrics.hh"
+#include "recorder.hh"
+#include "../lib/log.hh"
 
 EXEC SQL INCLUDE SQLCA;
 
 int verbose = 0;
+unsigned lockttl = 60;  // seconds until a lock expires without heartbeat
+static const char *recorddir = 0;  // directory for session recordings
 
 void
 throw_sql()
@@ -72,6 +80,33 @@ sig_term(int)
 typedef vector<TClient*> TClientList;
 TClientList clientlist;
 
+TTimerWheel timerwheel;
+
+TServerStats netedit::stats;
+TMemoryLimits netedit::memorylimits;
+
+static void collectMetrics(TMetricsServer*);
+static void encodeMemory(string *out);
+static void printMemory(ostream &out);
+
+/**
+ * Prints the statistics every 'interval' seconds.
+ */
+class TStatsDump:
+  public TTimer
+{
+  public:
+    unsigned interval;
+    void expired() {
+      // through the logger, whose writer shares stdout
+      ostringstream out;
+      stats.print(out, clientlist.size());
+      printMemory(out);
+      TLog::instance().write(out.str());
+      timerwheel.add(this, interval*1000);
+    }
+};
+
 /**
  * A list of all maps as read from the DBMS.
  */
@@ -80,15 +115,46 @@ main(int argc, char **argv)
 {
   cout << "NetEdit Server" << endl;
 
+  TStatsDump statsdump;
+  TMetricsServer metrics(collectMetrics);
   for(int i=1; i<argc; ++i) {
     if (strcmp(argv[i], "--verbose")==0) {
       ++verbose;
+    } else
+    if (strcmp(argv[i], "--lock-ttl")==0 && i+1<argc) {
+      lockttl = atoi(argv[++i]);
+    } else
+    if (strcmp(argv[i], "--metrics-port")==0 && i+1<argc) {
+      if (!metrics.listen(atoi(argv[++i])))
+        exit(EXIT_FAILURE);
+    } else
+    if (strcmp(argv[i], "--max-map-memory")==0 && i+1<argc) {
+      memorylimits.maps = strtoul(argv[++i], 0, 10);
+    } else
+    if (strcmp(argv[i], "--max-node-memory")==0 && i+1<argc) {
+      memorylimits.nodes = strtoul(argv[++i], 0, 10);
+    } else
+    if (strcmp(argv[i], "--max-client-memory")==0 && i+1<argc) {
+      memorylimits.client = strtoul(argv[++i], 0, 10);
+    } else
+    if (strcmp(argv[i], "--slow-sql")==0 && i+1<argc) {
+      stats.slowsql = atoi(argv[++i]) * 1000ULL;
+    } else
+    if (strcmp(argv[i], "--record")==0 && i+1<argc) {
+      recorddir = argv[++i];
+    } else
+    if (strcmp(argv[i], "--stats-interval")==0 && i+1<argc) {
+      statsdump.interval = atoi(argv[++i]);
+      if (statsdump.interval)
+        timerwheel.add(&statsdump, statsdump.interval*1000);
     } else {
       fprintf(stderr, "unknown argument '%s'\n", argv[i]);
       exit(EXIT_FAILURE);
     }
   }
 
+  TLog::setLevel(LOG_LEVEL_INFO + verbose);
+
   signal(SIGTERM, sig_term);
   signal(SIGINT,  sig_term);
 
@@ -101,7 +167,7 @@ main(int argc, char **argv)
     exit(EXIT_FAILURE);
   }
 
-  cout << "ready" << endl;
+  LOG_INFO("ready");
   fd_set rd0;
   FD_ZERO(&rd0);
   FD_SET(sock, &rd0);
@@ -109,14 +175,35 @@ main(int argc, char **argv)
   
   while(true) {
     fd_set rd = rd0;
-    select(max, &rd, NULL, NULL, NULL);
+    fd_set wr;
+    FD_ZERO(&wr);
+    for(TClientList::iterator p = clientlist.begin();
+        p != clientlist.end(); ++p)
+    {
+      if ((*p)->wantsWrite())
+        FD_SET((*p)->fd, &wr);
+    }
+    int n = max;
+    metrics.setFDs(&rd, &wr, &n);
+    timeval tv;
+    select(n, &rd, &wr, NULL, timerwheel.timeout(&tv));
+    unsigned long long start = TServerStats::clock();
+    timerwheel.run();
+    metrics.handle(&rd, &wr);
     if (FD_ISSET(sock, &rd)) {
       sockaddr_in cname;
-      int clen = sizeof(cname);
+      socklen_t clen = sizeof(cname);
       int client = accept(sock, (sockaddr*)&cname, &clen);
       if (client>=0) {
         fcntl(client, F_SETFL, O_NONBLOCK);
-        clientlist.push_back(new TClient(client));
+        TClient *c = new TClient(client);
+        if (recorddir) {
+          char peer[32];
+          snprintf(peer, sizeof(peer), "%s:%u",
+                   inet_ntoa(cname.sin_addr), ntohs(cname.sin_port));
+          c->recorder = TSessionRecorder::open(recorddir, peer);
+        }
+        clientlist.push_back(c);
         if (client>=max)
           max = client+1;
         FD_SET(client, &rd0);
@@ -127,15 +214,27 @@ main(int argc, char **argv)
     for(TClientList::iterator p = clientlist.begin();
         p != clientlist.end(); ++p)
     {
-      if (FD_ISSET((*p)->fd, &rd)) {
-        if (!(*p)->handle()) {
-          FD_CLR((*p)->fd, &rd0);
-          delete *p;
-          p = clientlist.erase(p);
-          --p;
+      bool ok = true;
+      if (FD_ISSET((*p)->fd, &rd))
+        ok = (*p)->handle();
+      if (ok && FD_ISSET((*p)->fd, &wr))
+        ok = (*p)->flush();
+      if (ok && memorylimits.client) {
+        size_t used = (*p)->memory().total();
+        if (used > memorylimits.client) {
+          LOG_WARN("disconnecting client " << (*p)->login << " which uses "
+                   << used << " bytes");
+          ok = false;
         }
       }
+      if (!ok) {
+        FD_CLR((*p)->fd, &rd0);
+        delete *p;
+        p = clientlist.erase(p);
+        --p;
+      }
     }
+    stats.loop.record(TServerStats::clock() - start);
   }
 
   EXEC SQL DISCONNECT;  
@@ -182,6 +281,9 @@ createSocket()
   return sock;
 }
 
+// capacity of the input buffer kept after all input has been handled
+static const size_t INPUT_KEEP = 16384;
+
 bool
 TClient::handle()
 {
@@ -200,16 +302,166 @@ TClient::handle()
       return false;
     }
     if (n==0) {
-      cout << "close connection" << endl;
+      LOG_INFO("close connection");
       close(fd);
       return false;
     }
     buffer.append(cbuffer, n);
     execute();
+    // erase() keeps the capacity, so don't charge an idle client for
+    // the largest message it ever sent
+    if (buffer.empty() && buffer.capacity() > INPUT_KEEP)
+      string().swap(buffer);
+  }
+  return true;
+}
+
+/**
+ * Queue a message for the client.
+ */
+void
+TClient::send(const string &msg, EPriority priority)
+{
+  outqueue[priority].push_back(msg);
+  outbytes += msg.size();
+  stats.sent(msg.size());
+}
+
+// amount of bulk data written to a client per event loop iteration
+static const size_t BULK_SLICE = 65536;
+
+/**
+ * Write queued messages to the client as far as the socket takes them.
+ *
+ * Between two messages pending control messages are always chosen
+ * first. Bulk data is written in slices of about BULK_SLICE bytes, after
+ * which the event loop gets a chance to handle other clients and to
+ * queue new control messages.
+ *
+ * The pages of maps being transfered are created when the bulk queue
+ * runs empty, so only a single page per client is held in memory. A
+ * page is completely written before anything else because it reflects
+ * the map at the time it was created.
+ *
+ * \return false when the connection failed
+ */
+bool
+TClient::flush()
+{
+  size_t bulk = 0;
+  while(true) {
+    if (outlane<0) {
+      if (!outqueue[PRIORITY_CONTROL].empty()) {
+        outlane = PRIORITY_CONTROL;
+      } else {
+        if (bulk >= BULK_SLICE)
+          break;
+        if (outqueue[PRIORITY_BULK].empty()) {
+          if (transfers.empty())
+            break;
+          TMapTransfer &transfer = transfers.front();
+          TMap *map = TMap::find(transfer.map_id);
+          stats.begin(CMD_OPEN_MAP);
+          if (transfer.refused ? !TMap::sendRefused(this, &transfer)
+                               : !map || !map->sendPage(this, &transfer))
+          {
+            transfers.pop_front();
+          }
+          stats.begin(0);
+          if (outqueue[PRIORITY_BULK].empty())
+            continue;
+        }
+        outlane = PRIORITY_BULK;
+      }
+    }
+    deque<string> &queue = outqueue[outlane];
+    const string &msg = queue.front();
+    ssize_t n = write(fd, msg.c_str()+outpos, msg.size()-outpos);
+    if (n<0) {
+      if (errno==EAGAIN)
+        break;
+      if (errno==EINTR)
+        continue;
+      perror("error when writing to client");
+      return false;
+    }
+    outpos += n;
+    if (outlane==PRIORITY_BULK)
+      bulk += n;
+    if (outpos==msg.size()) {
+      outbytes -= msg.size();
+      queue.pop_front();
+      outlane = -1;
+      outpos = 0;
+    }
   }
   return true;
 }
 
+/**
+ * Number of messages and bytes waiting to be written to the client.
+ */
+void
+TClient::queued(size_t *messages, size_t *bytes) const
+{
+  *messages = outqueue[0].size() + outqueue[1].size();
+  *bytes = outbytes - outpos;
+}
+
+/**
+ * Memory held by the client.
+ */
+TClientMemory
+TClient::memory() const
+{
+  TClientMemory m;
+  m.input = buffer.capacity();
+  m.mappings = (symmapping.size() + connmapping.size()) *
+               (TREE_NODE + sizeof(TIDMapping::value_type));
+  m.output = outbytes +
+             (outqueue[0].size() + outqueue[1].size()) * sizeof(string) +
+             transfers.size() * (sizeof(TMapTransfer) + 2*sizeof(void*));
+  return m;
+}
+
+/**
+ * Returns true when the symbol will be sent to the client as part of
+ * a map transfer which is still in progress.
+ */
+bool
+TClient::pendingSymbol(int map_id, int symbol_id) const
+{
+  for(TTransfers::const_iterator p = transfers.begin();
+      p != transfers.end();
+      ++p)
+  {
+    if (p->map_id != map_id)
+      continue;
+    return p->phase==TMapTransfer::HEADER ||
+           (p->phase==TMapTransfer::SYMBOLS && symbol_id>=p->next);
+  }
+  return false;
+}
+
+/**
+ * Returns true when the connection will be sent to the client as part
+ * of a map transfer which is still in progress.
+ */
+bool
+TClient::pendingConnection(int map_id, int conn_id) const
+{
+  for(TTransfers::const_iterator p = transfers.begin();
+      p != transfers.end();
+      ++p)
+  {
+    if (p->map_id != map_id)
+      continue;
+    return p->phase<=TMapTransfer::SYMBOLS ||
+           (p->phase==TMapTransfer::CONNECTIONS && conn_id>=p->next);
+  }
+  return false;
+}
+
 void
 TClient::execute()
 {
@@ -219,21 +471,32 @@ TClient::execute()
     if (buffer.size() < n)
       break;
     unsigned cmd = getDWord(buffer, &p);
+    if (recorder)
+      recorder->record(buffer, n);
+    unsigned long long start = TServerStats::clock();
+    stats.begin(cmd);
     switch(cmd) {
       case CMD_LOGIN: { // client side login request
         login = getString(buffer, &p);
         string passwd = getString(buffer, &p);
-        cout << "login by " << login << endl;
+        LOG_INFO("login by " << login);
       } break;
 
       case CMD_GET_MAPLIST: // retrieve map list
         sendMapList();
         break;
       case CMD_OPEN_MAP: // retrieve map
-        if (buffer.size()>=12)
-          sendMap(getSDWord(buffer, &p));
-        else
-          cout << "error: CMD_OPEN_MAP command is too small" << endl;
+        if (buffer.size()>=12) {
+          TMapTransfer transfer(getSDWord(buffer, &p));
+          if (n>=20) {
+            transfer.cached  = true;
+            transfer.epoch   = getDWord(buffer, &p);
+            transfer.version = getDWord(buffer, &p);
+          }
+          sendMap(transfer);
+        } else {
+          LOG_ERROR("CMD_OPEN_MAP command is too small");
+        }
         break;
       case CMD_CLOSE_MAP: // close map
         if (buffer.size()>=12)
@@ -245,11 +508,11 @@ TClient::execute()
           int map = getDWord(buffer, &p);
           int symid = getSDWord(buffer, &p);
           if (symid>=0) {
-            cout << "warning: attempt ignored to add symbol with non-temporary id" << endl;
+            LOG_WARN("attempt ignored to add symbol with non-temporary id");
           } else {
             int x  = getSDWord(buffer, &p);
             int y  = getSDWord(buffer, &p);
-            int newsymid = TMap::addSymbol(fd, map, symid, x, y);
+            int newsymid = TMap::addSymbol(this, map, symid, x, y);
             if (symid<0 && newsymid>=0)
               symmapping.insert(map, symid, newsymid);
           }
@@ -272,7 +535,7 @@ TClient::execute()
             int s = symmapping.map(map, sym);
             symmapping.erase(map, sym, s);
           }
-          TMap::deleteSymbol(fd, map, sym);
+          TMap::deleteSymbol(this, map, sym);
         }
         break;
       case CMD_TRANSLATE_SYMBOL: 
@@ -282,7 +545,7 @@ TClient::execute()
           if (map>=0 && sym>=0) {
             int x  = getSDWord(buffer, &p);
             int y  = getSDWord(buffer, &p);
-            TMap::translateSymbol(fd, map, sym, x, y);
+            TMap::translateSymbol(this, map, sym, x, y);
           }
         }
         break;
@@ -293,8 +556,8 @@ TClient::execute()
           int conn_id = getSDWord(buffer, &p);
           int sym0 = symmapping.map(map, getSDWord(buffer, &p));
           int sym1 = symmapping.map(map, getSDWord(buffer, &p));
-cout << "CMD_ADD_CONNECTION: map="<<map<<", conn="<<conn_id<<", sym0="<<sym0<<", sym1="<<sym1<<endl;
-          int newconnid = TMap::addConnection(fd, map, conn_id, sym0, sym1);
+          LOG_DEBUG("CMD_ADD_CONNECTION: map="<<map<<", conn="<<conn_id<<", sym0="<<sym0<<", sym1="<<sym1);
+          int newconnid = TMap::addConnection(this, map, conn_id, sym0, sym1);
           if (conn_id<0 && newconnid>=0)
             connmapping.insert(map, conn_id, newconnid);
         }
@@ -315,7 +578,7 @@ cout << "CMD_ADD_CONNECTION: map="<<map<<", conn="<<conn_id<<", sym0="<<sym0<<",
             int c = connmapping.map(map, conn);
             connmapping.erase(map, conn, c);
           }
-          TMap::deleteConnection(fd, map, conn);
+          TMap::deleteConnection(this, map, conn);
         }
         break;
         
@@ -346,10 +609,36 @@ cout << "CMD_ADD_CONNECTION: map="<<map<<", conn="<<conn_id<<", sym0="<<sym0<<",
           unlockNode(node_id);
         }
         break;
+
+      case CMD_HEARTBEAT:
+        heartbeat();
+        send(buffer.substr(0, n));
+        break;
+
+      case CMD_QUERY_REGION:
+        if (buffer.size()>=28) {
+          int map = getSDWord(buffer, &p);
+          int x   = getSDWord(buffer, &p);
+          int y   = getSDWord(buffer, &p);
+          int w   = getSDWord(buffer, &p);
+          int h   = getSDWord(buffer, &p);
+          TMap::queryRegion(this, map, x, y, w, h);
+        }
+        break;
+      case CMD_GET_STATS: {
+        string out;
+        addDWord(&out, 0);
+        addDWord(&out, CMD_GET_STATS);
+        stats.encode(&out, clientlist.size());
+        encodeMemory(&out);
+        setDWord(&out, 0, out.size());
+        send(out);
+      } break;
       default:
-        cout << "received unknown command " << cmd << endl;
+        LOG_WARN("received unknown command " << cmd);
         break;
     }
+    stats.end(n, start);
     buffer.erase(0, n);
   }
 }
@@ -370,10 +659,12 @@ TClient::sendMapList()
   EXEC SQL DECLARE cur_maplist CURSOR FOR
     SELECT map_id, name FROM map ORDER BY map_id;
 
+  TSQLTimer sqltimer("map list");
   EXEC SQL OPEN cur_maplist;
   EXEC SQL WHENEVER NOT FOUND DO break;
   while(true) {
     EXEC SQL FETCH FROM cur_maplist INTO :id, :name;
+    sqltimer.row();
     ++count;
 //    printf("got %u '%s'\n", id, name);
     addSDWord(&msg, id);
@@ -383,33 +674,62 @@ TClient::sendMapList()
   }
   EXEC SQL WHENEVER NOT FOUND SQLPRINT;
   EXEC SQL CLOSE cur_maplist;
+  sqltimer.stop();
 
-  if (verbose>0)
-    cout << "sending map list with " << count << " entries" << endl;
+  LOG_DEBUG("sending map list with " << count << " entries");
   setDWord(&msg, 8, count);
   setDWord(&msg, 0, msg.size());
-  write(fd, msg.c_str(), msg.size());
+  send(msg, PRIORITY_BULK);
 }
 
 void
-TClient::sendMap(int map_id)
+TClient::sendMap(const TMapTransfer &transfer)
 {
+  int map_id = transfer.map_id;
   if (map_id==0) {
-    cout << "warning: ignoring map_id==0, not sending it" << endl;
+    LOG_WARN("ignoring map_id==0, not sending it");
     return;
   }
 
-  if (verbose)
-    cout << "send map " << map_id << endl;
+  LOG_DEBUG("send map " << map_id);
 
   TMap *map = TMap::load(map_id);
-  map->send(fd);
+  if (!map) {
+    // reply with an empty map, after the maps requested before
+    TMapTransfer refused(map_id);
+    refused.refused = true;
+    transfers.push_back(refused);
+    return;
+  }
   map->clients.insert(this);
+  transfers.push_back(transfer);
 }
 
 void
 TClient::dropMap(int map_id)
 {
+  for(TTransfers::iterator p = transfers.begin();
+      p != transfers.end();
+      )
+  {
+    if (p->map_id == map_id)
+      p = transfers.erase(p);
+    else
+      ++p;
+  }
+
+  // tell the client which version of the map it holds now, so it can
+  // keep its copy for later. it has received all changes queued before.
+  TMap *map = TMap::find(map_id);
+  if (map && map->clients.find(this)!=map->clients.end()) {
+    string msg;
+    addDWord(&msg, 20);
+    addDWord(&msg, CMD_CLOSE_MAP);
+    addSDWord(&msg, map_id);
+    addDWord(&msg, TMap::epoch);
+    addDWord(&msg, map->revision());
+    send(msg);
+  }
   TMap::dropMap(this, map_id);
 }
 
@@ -425,11 +745,26 @@ class TInterface {
     string ifPhysAddress;
 };
 
+/**
+ * Locks on nodes are leases which expire unless the client holding
+ * the lock keeps sending heartbeats.
+ */
+class TLease:
+  public TTimer
+{
+  public:
+    TNode *node;
+    void expired();
+};
+
 class TNode
 {
   public:
     TNode() {
       lock = 0;
+      accounted = 0;
+      modified = false;
+      lease.node = this;
     }
     ~TNode() {
       for(TInterfaces::iterator p = interfaces.begin();
@@ -450,28 +785,106 @@ class TNode
     string mgmtaddr;
     unsigned mgmtflags;
     unsigned topoflags;
+    bool modified; // by a client since it was loaded
     
     typedef vector<TInterface*> TInterfaces;
     TInterfaces interfaces;
 
     TClient *lock;            // client who owns the lock or NULL
     time_t locktime;          // lock creation time
+    TLease lease;             // expires the lock
     
     set<TClient*> clients;    // clients referencing this node
+    size_t accounted;         // memory() when last accounted by TNodeCache
+
+    void unlock();
+    size_t memory() const;
 };
 
+/**
+ * Memory held by the node, including its entry in TNodeCache.
+ */
+size_t
+TNode::memory() const
+{
+  size_t n = sizeof(TNode) + TREE_NODE + sizeof(pair<const int, TNode*>) +
+             memoryOf(sysObjectID) + memoryOf(sysName) +
+             memoryOf(sysContact) + memoryOf(sysLocation) +
+             memoryOf(sysDescr) + memoryOf(mgmtaddr) +
+             interfaces.capacity() * sizeof(TInterface*) +
+             clients.size() * (TREE_NODE + sizeof(TClient*));
+  for(TInterfaces::const_iterator p = interfaces.begin();
+      p != interfaces.end();
+      ++p)
+  {
+    n += sizeof(TInterface) + memoryOf((*p)->ipaddress) +
+         memoryOf((*p)->ifDescr) + memoryOf((*p)->ifPhysAddress);
+  }
+  return n;
+}
+
+void
+TLease::expired()
+{
+  LOG_DEBUG("lock on node " << node->node_id << " expired");
+  node->unlock();
+}
+
+/**
+ * Drop the lock and inform all clients referencing the node.
+ */
+void
+TNode::unlock()
+{
+  if (!lock)
+    return;
+  lock->locks.erase(this);
+  lock = 0;
+  lease.cancel();
+
+  string out;
+  addDWord(&out, 0);
+  addDWord(&out, CMD_UNLOCK_NODE);
+  addDWord(&out, node_id);
+  setDWord (&out, 0, out.size());
+
+  for(set<TClient*>::iterator p=clients.begin();
+      p!=clients.end();
+      ++p)
+  {
+    (*p)->send(out);
+  }
+  stats.fanout.record(clients.size());
+}
+
 class TNodeCache
 {
   private:
     typedef map<int, TNode*> TStorage;
     TStorage storage;
+    size_t bytes;
   public:
+    TNodeCache() { bytes = 0; }
     TNode *get(TClient *client, int node_id);
     TNode *getCached(int node_id);
     void drop(TClient *client, int node_id);
     void closeClient(TClient *client);
+    size_t size() const { return storage.size(); }
+    size_t memory() const { return bytes; }
+    void account(TNode *node);
 };
 
+/**
+ * Update the memory held by the cache after 'node' was modified.
+ */
+void
+TNodeCache::account(TNode *node)
+{
+  size_t n = node->memory();
+  bytes += n - node->accounted;
+  node->accounted = n;
+}
+
 TNodeCache nodecache;
 
 TNode*
@@ -489,6 +902,11 @@ TNodeCache::get(TClient *client, int node_id)
   if (p!=storage.end()) {
     node = p->second;
   } else {
+    if (memorylimits.nodes && bytes >= memorylimits.nodes) {
+      LOG_WARN("refused to load node " << node_id << ", nodes use "
+               << bytes << " bytes");
+      return 0;
+    }
     EXEC SQL BEGIN DECLARE SECTION;
     varchar sysObjectID[252];
     varchar sysName[252];
@@ -520,6 +938,8 @@ TNodeCache::get(TClient *client, int node_id)
     mgmtflags = 0;
     topoflags = 0;
 
+    TSQLTimer sqltimer("load node");
+    sqltimer.param("node_id", id);
     EXEC SQL
       SELECT sysObjectID, 
              sysName, 
@@ -541,6 +961,8 @@ TNodeCache::get(TClient *client, int node_id)
              :topoflags :flag
       FROM   node
       WHERE  node_id = :id;
+    sqltimer.rows(sqlca.sqlerrd[2]);
+    sqltimer.stop();
       
     node = new TNode;
     node->node_id = node_id;
@@ -560,6 +982,8 @@ TNodeCache::get(TClient *client, int node_id)
              ifPhysAddress
       FROM interface ORDER BY ifIndex;
       
+    TSQLTimer sqltimer2("load interfaces");
+    sqltimer2.param("node_id", id);
     EXEC SQL OPEN cur_interfaces;
     EXEC SQL WHENEVER NOT FOUND DO break;
     while(true) {
@@ -581,6 +1005,7 @@ TNodeCache::get(TClient *client, int node_id)
                     :ifDescr :flag,
                     :ifType :flag,
                     :ifPhysAddress :flag;
+      sqltimer2.row();
       TInterface *in = new TInterface;
       in->interface_id = interface_id;
       in->status       = status;
@@ -594,6 +1019,8 @@ TNodeCache::get(TClient *client, int node_id)
     }
     EXEC SQL WHENEVER NOT FOUND SQLPRINT;
     EXEC SQL CLOSE cur_interfaces;
+    sqltimer2.stop();
+    account(node);
   }
   return node;
 }
@@ -603,22 +1030,22 @@ TNodeCache::drop(TClient *client, int node_id)
 {
   TStorage::iterator p = storage.find(node_id);
   if (p==storage.end()) {
-    cout << "warning: client tried to drop inactive node" << endl;
+    LOG_WARN("client tried to drop inactive node");
     return;
   }
   
   TNode* node = p->second;
   set<TClient*>::iterator c = node->clients.find(client);
   if (c==node->clients.end()) {
-    cout << "warning: client tried to drop non-existent lease on node" << endl;
+    LOG_WARN("client tried to drop non-existent lease on node");
     return;
   }
   
-  // drop reference to node
+  // drop reference to node and inform the others about a dropped lock
   node->clients.erase(c);
   if (node->lock == client)
-    node->lock = 0;
-  #warning "should inform other clients about dropped lock"
+    node->unlock();
+  account(node);
   
   // write node to DBMS when last client is detached
   if (node->clients.empty()) {
@@ -642,14 +1069,16 @@ TNodeCache::drop(TClient *client, int node_id)
     mgmtflags   = node->mgmtflags;
     topoflags   = node->topoflags;
     
-    cout << "node_id = " << node_id << endl;
-    cout << "sysObjectID = " << sysObjectID << endl;
-    cout << "sysName     = " << sysName << endl;
-    cout << "sysContact  = " << sysContact << endl;
-    cout << "sysLocation = " << sysLocation << endl;
-    cout << "sysDescr    = " << sysDescr << endl;
-    cout << "mgmtaddr    = " << mgmtaddr << endl;
+    LOG_TRACE("node_id = " << node_id);
+    LOG_TRACE("sysObjectID = " << sysObjectID);
+    LOG_TRACE("sysName     = " << sysName);
+    LOG_TRACE("sysContact  = " << sysContact);
+    LOG_TRACE("sysLocation = " << sysLocation);
+    LOG_TRACE("sysDescr    = " << sysDescr);
+    LOG_TRACE("mgmtaddr    = " << mgmtaddr);
 
+    TSQLTimer sqltimer("update node");
+    sqltimer.param("node_id", nid);
     EXEC SQL
       UPDATE node
       SET    sysObjectID = :sysObjectID,
@@ -659,8 +1088,18 @@ TNodeCache::drop(TClient *client, int node_id)
              sysDescr    = :sysDescr,
              mgmtaddr    = :mgmtaddr
       WHERE  node_id = :nid;
+    sqltimer.rows(sqlca.sqlerrd[2]);
+    sqltimer.stop();
 
+    sqltimer = TSQLTimer("commit node");
+    sqltimer.param("node_id", nid);
     EXEC SQL COMMIT;
+    sqltimer.stop();
+    // maps loaded from now on show the node as stored
+    if (node->modified)
+      ++TMap::nodes;
+    bytes -= node->accounted;
+    node->unlock(); // in case a client locked it without opening it
     delete node;
     storage.erase(p);
   }
@@ -687,14 +1126,16 @@ TNodeCache::closeClient(TClient *client)
 void
 TClient::openNode(int node_id)
 {
-  if (verbose>1)
-    cout << "open node " << node_id << endl;
+  LOG_TRACE("open node " << node_id);
   TNode *node = nodecache.get(this, node_id);
 
-  if (node->clients.find(this)!=node->clients.end()) {
-    cout << "warning: client retrieves node more than once and may be broken" << endl;
+  if (node) {
+    if (node->clients.find(this)!=node->clients.end()) {
+      LOG_WARN("client retrieves node more than once and may be broken");
+    }
+    node->clients.insert(this);
+    nodecache.account(node);
   }
-  node->clients.insert(this);
 
   string msg;
   addDWord(&msg, 0);
@@ -738,24 +1179,24 @@ TClient::openNode(int node_id)
     }
   }
   setDWord(&msg, 0, msg.size());
-  write(fd, msg.c_str(), msg.size());
+  send(msg);
 }
 
 void
 TClient::setNode(const string &msg, unsigned *p)
 {
   int node_id = getDWord(msg, p);
-  if (verbose>1)
-    cout << "set node " << node_id << endl;
+  LOG_TRACE("set node " << node_id);
   TNode *node = nodecache.get(this, node_id);
   if (!node) {
-    cout << "error: can't set node because it wasn't found" << endl;
+    LOG_ERROR("can't set node because it wasn't found");
     return;
   }
   if (node->lock != this) {
-    cout << "error: can't set node because client doesn't held lock" << endl;
+    LOG_ERROR("can't set node because client doesn't held lock");
     return;
   }
+  timerwheel.add(&node->lease, lockttl*1000);
   node->sysObjectID = getString(msg, p);
   node->sysName     = getString(msg, p);
   node->sysContact  = getString(msg, p);
@@ -765,6 +1206,9 @@ TClient::setNode(const string &msg, unsigned *p)
   node->mgmtaddr    = getString(msg, p);
   node->mgmtflags   = getDWord(msg, p);
   node->topoflags   = getDWord(msg, p);
+  nodecache.account(node);
+  node->modified = true;
+  ++TMap::nodes;
   
   string out;
   addDWord(&out, 0);
@@ -780,43 +1224,47 @@ TClient::setNode(const string &msg, unsigned *p)
   addString(&out, node->mgmtaddr);
   addDWord (&out, node->mgmtflags);
   addDWord (&out, node->topoflags);
-  setDWord (&out, 0, msg.size());
+  setDWord (&out, 0, out.size());
 
+  unsigned fanout = 0;
   for(set<TClient*>::iterator p=node->clients.begin();
       p!=node->clients.end();
       ++p)
   {
     if (*p != this) {
-      write((*p)->fd, out.c_str(), out.size());
+      (*p)->send(out);
+      ++fanout;
     }
   }
+  stats.fanout.record(fanout);
 }
 
 void
 TClient::closeNode(int node_id)
 {
   unlockNode(node_id);
-  if (verbose>1)
-    cout << "drop node " << node_id << endl;
+  LOG_TRACE("drop node " << node_id);
   nodecache.drop(this, node_id);
 }
 
 void
 TClient::lockNode(int node_id)
 {
-  if (verbose>1)
-    cout << "lock node " << node_id << endl;
+  LOG_TRACE("lock node " << node_id);
   TNode *node = nodecache.getCached(node_id);
+  if (!node || !node->clients.count(this)) {
+    LOG_ERROR("client tried to lock node it hasn't opened");
+    return;
+  }
   if (node->lock) {
-    if (verbose>1)
-      cout << "warning: client tried to lock already locked node" << endl;
+    LOG_DEBUG("client tried to lock already locked node");
     return;
   }
 
-cout << "lock node " << node_id << endl;
-
   node->lock = this;
   node->locktime = time(NULL);
+  locks.insert(node);
+  timerwheel.add(&node->lease, lockttl*1000);
 
   string out;
   addDWord(&out, 0);
@@ -833,37 +1281,273 @@ cout << "lock node " << node_id << endl;
       ++p)
   {
     setByte(&out, 12, node->lock==*p ? NODE_LOCKED_LOCAL : NODE_LOCKED_REMOTE);
-    write((*p)->fd, out.c_str(), out.size());
+    (*p)->send(out);
   }
+  stats.fanout.record(node->clients.size());
 }
 
 void
 TClient::unlockNode(int node_id)
 {
-  if (verbose>1)
-    cout << "unlock node " << node_id << endl;
+  LOG_TRACE("unlock node " << node_id);
   TNode *node = nodecache.getCached(node_id);
-  if (node->lock!=this) {
+  if (!node || node->lock!=this) {
 //    cout << "error: client tried to drop non-existing or foreign lock" << endl;
     return;
   }
-  node->lock = 0;
-  string out;
-  addDWord(&out, 0);
-  addDWord(&out, CMD_UNLOCK_NODE);
-  addDWord(&out, node_id);
-  setDWord (&out, 0, out.size());
+  node->unlock();
+}
 
-  for(set<TClient*>::iterator p=node->clients.begin();
-      p!=node->clients.end();
+/**
+ * The client is alive, renew the leases on all it's locks.
+ */
+void
+TClient::heartbeat()
+{
+  for(set<TNode*>::iterator p = locks.begin();
+      p != locks.end();
       ++p)
   {
-    write((*p)->fd, out.c_str(), out.size());
+    timerwheel.add(&(*p)->lease, lockttl*1000);
   }
 }
 
 TClient::~TClient()
 {
+  TMap::closeClient(this);
   nodecache.closeClient(this);
+  while(!locks.empty())
+    (*locks.begin())->unlock();
+  delete recorder;
   close(fd);
 }
+
+/**
+ * Append the memory figures to the CMD_GET_STATS reply:
+ *
+ *   dword n, n times: dword map id, dword clients, qword bytes of
+ *                     symbols, qword connections, qword strings
+ *   dword cached nodes, qword bytes of nodes
+ *   dword m, m times: string login, qword bytes of input, qword
+ *                     id mappings, qword output
+ */
+static void
+encodeMemory(string *out)
+{
+  const TMap::TMapMap &maps = TMap::all();
+  addDWord(out, maps.size());
+  for(TMap::TMapMap::const_iterator p = maps.begin();
+      p != maps.end();
+      ++p)
+  {
+    const TMapMemory &m = p->second->memory;
+    addSDWord(out, p->first);
+    addDWord(out, p->second->clients.size());
+    addQWord(out, m.symbols);
+    addQWord(out, m.connections);
+    addQWord(out, m.strings);
+  }
+  addDWord(out, nodecache.size());
+  addQWord(out, nodecache.memory());
+  addDWord(out, clientlist.size());
+  for(TClientList::const_iterator p = clientlist.begin();
+      p != clientlist.end();
+      ++p)
+  {
+    TClientMemory m = (*p)->memory();
+    addString(out, (*p)->login);
+    addQWord(out, m.input);
+    addQWord(out, m.mappings);
+    addQWord(out, m.output);
+  }
+}
+
+static void
+printMemory(ostream &out)
+{
+  char line[160];
+  snprintf(line, sizeof(line), "%-20s %9s %9s %9s %9s\n",
+           "memory (bytes)", "total", "symbols", "conns", "strings");
+  out << line;
+  const TMap::TMapMap &maps = TMap::all();
+  for(TMap::TMapMap::const_iterator p = maps.begin();
+      p != maps.end();
+      ++p)
+  {
+    const TMapMemory &m = p->second->memory;
+    snprintf(line, sizeof(line), "map %-16d %9zu %9zu %9zu %9zu\n",
+             p->first, m.total(), m.symbols, m.connections, m.strings);
+    out << line;
+  }
+  snprintf(line, sizeof(line), "%-20s %9zu\n",
+           "nodes", nodecache.memory());
+  out << line;
+  snprintf(line, sizeof(line), "%-20s %9s %9s %9s %9s\n",
+           "", "total", "input", "mappings", "output");
+  out << line;
+  for(TClientList::const_iterator p = clientlist.begin();
+      p != clientlist.end();
+      ++p)
+  {
+    TClientMemory m = (*p)->memory();
+    snprintf(line, sizeof(line), "client %-13d %9zu %9zu %9zu %9zu\n",
+             (*p)->fd, m.total(), m.input, m.mappings, m.output);
+    out << line;
+  }
+  out.flush();
+}
+
+/**
+ * Write the metrics served by --metrics-port.
+ */
+static void
+collectMetrics(TMetricsServer *m)
+{
+  char labels[128];
+
+  m->metric("neteditd_uptime_seconds", "gauge",
+            "Time since the server was started.");
+  m->sample("neteditd_uptime_seconds", 0, time(NULL) - stats.started);
+
+  m->metric("neteditd_clients", "gauge", "Connected clients.");
+  m->sample("neteditd_clients", 0, clientlist.size());
+
+  m->metric("neteditd_maps_open", "gauge", "Maps held in memory.");
+  m->sample("neteditd_maps_open", 0, TMap::count());
+
+  m->metric("neteditd_nodes_cached", "gauge", "Nodes held in memory.");
+  m->sample("neteditd_nodes_cached", 0, nodecache.size());
+
+  size_t locks = 0, messages = 0, bytes = 0, maxbytes = 0;
+  for(TClientList::iterator p = clientlist.begin();
+      p != clientlist.end();
+      ++p)
+  {
+    size_t n, b;
+    (*p)->queued(&n, &b);
+    locks += (*p)->locks.size();
+    messages += n;
+    bytes += b;
+    if (b>maxbytes)
+      maxbytes = b;
+  }
+  m->metric("neteditd_map_memory_bytes", "gauge",
+            "Memory held by the maps in memory.");
+  snprintf(labels, sizeof(labels), "part=\"symbols\"");
+  m->sample("neteditd_map_memory_bytes", labels, TMap::allocated.symbols);
+  snprintf(labels, sizeof(labels), "part=\"connections\"");
+  m->sample("neteditd_map_memory_bytes", labels,
+            TMap::allocated.connections);
+  snprintf(labels, sizeof(labels), "part=\"strings\"");
+  m->sample("neteditd_map_memory_bytes", labels, TMap::allocated.strings);
+
+  m->metric("neteditd_node_memory_bytes", "gauge",
+            "Memory held by the node cache.");
+  m->sample("neteditd_node_memory_bytes", 0, nodecache.memory());
+
+  TClientMemory clients;
+  for(TClientList::iterator p = clientlist.begin();
+      p != clientlist.end();
+      ++p)
+  {
+    TClientMemory c = (*p)->memory();
+    clients.input += c.input;
+    clients.mappings += c.mappings;
+    clients.output += c.output;
+  }
+  m->metric("neteditd_client_memory_bytes", "gauge",
+            "Memory held by all clients.");
+  snprintf(labels, sizeof(labels), "part=\"input\"");
+  m->sample("neteditd_client_memory_bytes", labels, clients.input);
+  snprintf(labels, sizeof(labels), "part=\"mappings\"");
+  m->sample("neteditd_client_memory_bytes", labels, clients.mappings);
+  snprintf(labels, sizeof(labels), "part=\"output\"");
+  m->sample("neteditd_client_memory_bytes", labels, clients.output);
+
+  m->metric("neteditd_locks_held", "gauge", "Nodes locked by clients.");
+  m->sample("neteditd_locks_held", 0, locks);
+  m->metric("neteditd_outqueue_messages", "gauge",
+            "Messages waiting to be written to clients.");
+  m->sample("neteditd_outqueue_messages", 0, messages);
+  m->metric("neteditd_outqueue_bytes", "gauge",
+            "Bytes waiting to be written to clients.");
+  m->sample("neteditd_outqueue_bytes", 0, bytes);
+  m->metric("neteditd_outqueue_bytes_max", "gauge",
+            "Bytes waiting to be written to the slowest client.");
+  m->sample("neteditd_outqueue_bytes_max", 0, maxbytes);
+
+  m->metric("neteditd_loop_seconds", "summary",
+            "Time spent per event loop iteration, without waiting.");
+  m->summary("neteditd_loop_seconds", 0, stats.loop, 1e-6);
+
+  m->metric("neteditd_broadcast_clients", "summary",
+            "Number of clients receiving a broadcast.");
+  m->summary("neteditd_broadcast_clients", 0, stats.fanout);
+
+  m->metric("neteditd_commands_total", "counter", "Commands executed.");
+  for(unsigned i=0; i<TServerStats::COMMANDS; ++i) {
+    if (!stats.command[i].count)
+      continue;
+    snprintf(labels, sizeof(labels), "command=\"%s\"",
+             i ? commandName(i) : "OTHER");
+    m->sample("neteditd_commands_total", labels, stats.command[i].count);
+  }
+  m->metric("neteditd_command_received_bytes_total", "counter",
+            "Bytes received per command.");
+  for(unsigned i=0; i<TServerStats::COMMANDS; ++i) {
+    if (!stats.command[i].count)
+      continue;
+    snprintf(labels, sizeof(labels), "command=\"%s\"",
+             i ? commandName(i) : "OTHER");
+    m->sample("neteditd_command_received_bytes_total", labels,
+              stats.command[i].bytes_in);
+  }
+  m->metric("neteditd_command_sent_bytes_total", "counter",
+            "Bytes of replies and broadcasts caused per command.");
+  for(unsigned i=0; i<TServerStats::COMMANDS; ++i) {
+    if (!stats.command[i].count)
+      continue;
+    snprintf(labels, sizeof(labels), "command=\"%s\"",
+             i ? commandName(i) : "OTHER");
+    m->sample("neteditd_command_sent_bytes_total", labels,
+              stats.command[i].bytes_out);
+  }
+  m->metric("neteditd_command_seconds", "summary",
+            "Time spent executing a command.");
+  for(unsigned i=0; i<TServerStats::COMMANDS; ++i) {
+    if (!stats.command[i].count)
+      continue;
+    snprintf(labels, sizeof(labels), "command=\"%s\"",
+             i ? commandName(i) : "OTHER");
+    m->summary("neteditd_command_seconds", labels,
+               stats.command[i].latency, 1e-6);
+  }
+
+  m->metric("neteditd_sql_seconds", "summary",
+            "Database round trip time per statement site.");
+  for(TServerStats::TSQLSites::const_iterator p = stats.sql.begin();
+      p != stats.sql.end();
+      ++p)
+  {
+    snprintf(labels, sizeof(labels), "site=\"%s\"", p->first.c_str());
+    m->summary("neteditd_sql_seconds", labels, p->second.time, 1e-6);
+  }
+  m->metric("neteditd_sql_rows", "summary",
+            "Rows fetched or affected per statement site.");
+  for(TServerStats::TSQLSites::const_iterator p = stats.sql.begin();
+      p != stats.sql.end();
+      ++p)
+  {
+    snprintf(labels, sizeof(labels), "site=\"%s\"", p->first.c_str());
+    m->summary("neteditd_sql_rows", labels, p->second.rows);
+  }
+  m->metric("neteditd_sql_slow_total", "counter",
+            "Statements which took longer than --slow-sql.");
+  for(TServerStats::TSQLSites::const_iterator p = stats.sql.begin();
+      p != stats.sql.end();
+      ++p)
+  {
+    snprintf(labels, sizeof(labels), "site=\"%s\"", p->first.c_str());
+    m->sample("neteditd_sql_slow_total", labels, p->second.slow);
+  }
+}
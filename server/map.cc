@@ -20,27 +20,56 @@
 #include "map.hh"
 #include "../lib/common.hh"
 #include "../lib/binary.hh"
+#include "stats.hh"
+#include "../lib/log.hh"
+#include <time.h>
+
+EXEC SQL INCLUDE SQLCA;
 
 using namespace netedit;
 
-extern int verbose;
+static TMapMemory
+symbolMemory(const TMap::TSymbol *s)
+{
+  TMapMemory m;
+  m.symbols = sizeof(TMap::TSymbol) +
+              TREE_NODE + sizeof(TMap::TSymbols::value_type) +
+              sizeof(TMap::TSymbol*);
+  m.strings = memoryOf(s->sysName) + memoryOf(s->type);
+  return m;
+}
+
+static TMapMemory
+connectionMemory(const TMap::TConnection *c)
+{
+  TMapMemory m;
+  m.connections = sizeof(TMap::TConnection) +
+                  TREE_NODE + sizeof(TMap::TConnections::value_type);
+  return m;
+}
 
 TMap::TMapMap TMap::mapmap;
+TMap::TVersions TMap::versions;
+const unsigned TMap::epoch = time(NULL);
+unsigned TMap::nodes = 0;
+TMapMemory TMap::allocated;
 
 TMap::~TMap()
 {
-  for(vector<TSymbol*>::iterator p = symbols.begin();
+  allocated -= memory;
+
+  for(TSymbols::iterator p = symbols.begin();
       p != symbols.end();
       ++p)
   {
-    delete *p;
+    delete p->second;
   }
 
-  for(vector<TConnection*>::iterator p = connections.begin();
+  for(TConnections::iterator p = connections.begin();
       p != connections.end();
       ++p)
   {
-    delete *p;
+    delete p->second;
   }
 }
 
@@ -61,8 +90,18 @@ TMap::load(int mapid)
 
   TMapMap::iterator mp = mapmap.find(map_id);
   if (mp==mapmap.end()) {
+    if (full()) {
+      LOG_WARN("refused to load map " << map_id << ", maps use "
+               << allocated.total() << " bytes");
+      return 0;
+    }
     map = new TMap;
     map->id = map_id;
+    TVersions::iterator vp = versions.find(map_id);
+    if (vp!=versions.end()) {
+      map->version = vp->second;
+      versions.erase(vp);
+    }
 
     // symbols for node
     EXEC SQL DECLARE cur_sym_node CURSOR FOR
@@ -75,6 +114,8 @@ TMap::load(int mapid)
         symbol.id = node.node_id AND
         node.sysObjectID = icon.sysObjectID;
 
+    TSQLTimer sqltimer("load map symbols");
+    sqltimer.param("map_id", map_id);
     EXEC SQL OPEN cur_sym_node;
     EXEC SQL WHENEVER NOT FOUND DO break;
     while(true) {
@@ -82,17 +123,14 @@ TMap::load(int mapid)
       *type = 0;
       EXEC SQL FETCH FROM cur_sym_node 
                      INTO :symbol_id, :objid, :x, :y, :name, :type;
-      if (verbose>1)
-        cout << symbol_id << ", "
-             << objid << ", "
-             << x << ", "
-             << y << ", "
-             << name << ", "
-             << type << endl;
+      sqltimer.row();
+      LOG_TRACE(symbol_id << ", " << objid << ", " << x << ", " << y << ", "
+                << name << ", " << type);
       map->addSymbol(symbol_id, objid, x, y, name, type);
     }
     EXEC SQL WHENEVER NOT FOUND SQLPRINT;
     EXEC SQL CLOSE cur_sym_node;
+    sqltimer.stop();
 
     // symbols for maps
     EXEC SQL DECLARE cur_sym_map CURSOR FOR
@@ -103,6 +141,8 @@ TMap::load(int mapid)
         symbol.map_id = :map_id AND
         symbol.id = map.map_id;
 
+    sqltimer = TSQLTimer("load map submaps");
+    sqltimer.param("map_id", map_id);
     EXEC SQL OPEN cur_sym_map;
     EXEC SQL WHENEVER NOT FOUND DO break;
     while(true) {
@@ -110,36 +150,32 @@ TMap::load(int mapid)
       *type = 0;
       EXEC SQL FETCH FROM cur_sym_map 
                      INTO :symbol_id, :objid, :x, :y, :name;
-      if (verbose>1)
-        cout << "symbol: "
-             << symbol_id << ", "
-             << objid << ", "
-             << x << ", "
-             << y << ", "
-             << name << endl;
+      sqltimer.row();
+      LOG_TRACE("symbol: " << symbol_id << ", " << objid << ", "
+                << x << ", " << y << ", " << name);
       map->addSymbol(symbol_id, objid, x, y, name, "Map:Submap");
     }
     EXEC SQL WHENEVER NOT FOUND SQLPRINT;
     EXEC SQL CLOSE cur_sym_map;
+    sqltimer.stop();
 
     // connections
     EXEC SQL DECLARE cur_conn CURSOR FOR
       SELECT DISTINCT conn_id, id0, id1 FROM conn WHERE map_id = :map_id;
 
+    sqltimer = TSQLTimer("load map connections");
+    sqltimer.param("map_id", map_id);
     EXEC SQL OPEN cur_conn;
     EXEC SQL WHENEVER NOT FOUND DO break;
     while(true) {
       EXEC SQL FETCH FROM cur_conn INTO :conn_id, :s0, :s1;
-      if (verbose>1) {
-        cout << "connection: "
-             << conn_id << ", "
-             << s0 << ", "
-             << s1 << endl;
-      }
+      sqltimer.row();
+      LOG_TRACE("connection: " << conn_id << ", " << s0 << ", " << s1);
       map->addConnection(conn_id, s0, s1);
     }
     EXEC SQL WHENEVER NOT FOUND SQLPRINT;
     EXEC SQL CLOSE cur_conn;
+    sqltimer.stop();
 
     mapmap[map_id] = map;
   } else {
@@ -149,11 +185,25 @@ TMap::load(int mapid)
   return map;
 }
 
+/**
+ * Return the active map with the given id or NULL.
+ */
+TMap*
+TMap::find(int map_id)
+{
+  TMapMap::iterator p = mapmap.find(map_id);
+  return p!=mapmap.end() ? p->second : 0;
+}
+
 void
 TMap::addSymbol(int symbol_id, int objid,
                 int x, int y, const string &name,
                 const string &type)
 {
+  if (symbols.find(symbol_id)!=symbols.end()) {
+    LOG_WARN("TMap::addSymbol: duplicate symbol " << symbol_id);
+    return;
+  }
   TSymbol *s = new TSymbol;
   s->symbol_id = symbol_id;
   s->objid     = objid;
@@ -161,17 +211,38 @@ TMap::addSymbol(int symbol_id, int objid,
   s->y         = y;
   s->sysName   = name;
   s->type      = type;
-  symbols.push_back(s);
+  symbols[symbol_id] = s;
+  grid.insert(s);
+  allocate(symbolMemory(s));
 }
 
 void
 TMap::addConnection(int conn_id, int id0, int id1)
 {
+  if (connections.find(conn_id)!=connections.end()) {
+    LOG_WARN("TMap::addConnection: duplicate connection " << conn_id);
+    return;
+  }
   TConnection *c = new TConnection;
   c->conn_id = conn_id;
   c->id0 = id0;
   c->id1 = id1;
-  connections.push_back(c);
+  connections[conn_id] = c;
+  allocate(connectionMemory(c));
+}
+
+void
+TMap::allocate(const TMapMemory &m)
+{
+  memory += m;
+  allocated += m;
+}
+
+void
+TMap::release(const TMapMemory &m)
+{
+  memory -= m;
+  allocated -= m;
 }
 
 /**
@@ -188,136 +259,288 @@ TMap::dropMap(TClient *client, int aMap)
   
   TMapMap::iterator p = mapmap.find(map);
   if (p==mapmap.end()) {
-    cout << "TMap::dropMap: map " << map << " isn't active" << endl;
+    LOG_WARN("TMap::dropMap: map " << map << " isn't active");
     return;
   }
   TMap *m = p->second;
   set<TClient*>::iterator c = m->clients.find(client);
   if (c==m->clients.end()) {
-    cout << "TMap::dropMap: client hasn't opened map" << endl;
+    LOG_WARN("TMap::dropMap: client hasn't opened map");
     return;
   }
   
   m->clients.erase(c);
   if (m->clients.empty()) {
-    cout << "store and free map " << map << endl;
+    LOG_INFO("store and free map " << map);
     
 //    EXEC SQL START TRANSACTION;
 
     // erase old map
+    TSQLTimer sqltimer("delete map connections");
+    sqltimer.param("map_id", map);
     EXEC SQL DELETE FROM conn WHERE map_id = :map;
+    sqltimer.rows(sqlca.sqlerrd[2]);
+    sqltimer.stop();
+
+    sqltimer = TSQLTimer("delete map symbols");
+    sqltimer.param("map_id", map);
     EXEC SQL DELETE FROM symbol WHERE map_id = :map;
+    sqltimer.rows(sqlca.sqlerrd[2]);
+    sqltimer.stop();
 
     // insert new map
-    for(vector<TSymbol*>::iterator q = m->symbols.begin();
+    TSQLTimer inserts("insert symbol");
+    for(TSymbols::iterator q = m->symbols.begin();
         q != m->symbols.end();
         ++q)
     {
       EXEC SQL BEGIN DECLARE SECTION;
-      int id    = (*q)->symbol_id;
-      int objid = (*q)->objid;
-      int x     = (*q)->x;
-      int y     = (*q)->y;
+      int id    = q->second->symbol_id;
+      int objid = q->second->objid;
+      int x     = q->second->x;
+      int y     = q->second->y;
       EXEC SQL END DECLARE SECTION;
+      inserts.restart();
+      inserts.param("map_id", map);
+      inserts.param("symbol_id", id);
       EXEC SQL INSERT INTO symbol(map_id, symbol_id, id, xpos, ypos)
         VALUES (:map, :id, :objid, :x, :y);
+      inserts.rows(sqlca.sqlerrd[2]);
+      inserts.stop();
     }
     
-    for(vector<TConnection*>::iterator q = m->connections.begin();
+    inserts = TSQLTimer("insert connection");
+    for(TConnections::iterator q = m->connections.begin();
         q != m->connections.end();
         ++q)
     {
       EXEC SQL BEGIN DECLARE SECTION;
-      int id  = (*q)->conn_id;
-      int id0 = (*q)->id0;
-      int id1 = (*q)->id1; 
+      int id  = q->second->conn_id;
+      int id0 = q->second->id0;
+      int id1 = q->second->id1; 
       EXEC SQL END DECLARE SECTION;
-cout << "connection " << id0 << " and " << id1 << endl;
+      LOG_TRACE("connection " << id0 << " and " << id1);
+      inserts.restart();
+      inserts.param("map_id", map);
+      inserts.param("conn_id", id);
       EXEC SQL INSERT INTO conn(map_id, conn_id, id0, id1)
         VALUES (:map, :id, :id0, :id1);
+      inserts.rows(sqlca.sqlerrd[2]);
+      inserts.stop();
     }
     
+    sqltimer = TSQLTimer("commit map");
+    sqltimer.param("map_id", map);
     EXEC SQL COMMIT;
-
+    sqltimer.stop();
+
+    // the names read with the next load differ from those sent with
+    // this one when a node has changed in between, so clients must not
+    // be able to confirm their copy against the version kept
+    if (m->loadednodes != nodes)
+      versions[map] = m->revision() + 1;
+    else
+      versions[map] = m->version;
     mapmap.erase(p);
+    delete m;
   }
 }
 
+/**
+ * Store the close map request on the DBMS for all maps the client has
+ * opened, ie. when the client disconnects.
+ */
 void
-TMap::send(int fd)
+TMap::closeClient(TClient *client)
 {
-  if (verbose>1)
-    cout << "sending map: " << symbols.size() << " symbols, "
-                            << connections.size() << " connections"
-                            << endl;
-
-  string msg;
-  addDWord(&msg, 0);
-  addDWord(&msg, CMD_OPEN_MAP);
-  addSDWord(&msg, id);
-  
-  addDWord(&msg, symbols.size());
-  for(vector<TSymbol*>::iterator p = symbols.begin();
-      p != symbols.end();
+  vector<int> ids;
+  for(TMapMap::iterator p = mapmap.begin();
+      p != mapmap.end();
       ++p)
   {
-     addSDWord(&msg, (*p)->symbol_id);
-     addSDWord(&msg, (*p)->objid);
-     addSDWord(&msg, (*p)->x);
-     addSDWord(&msg, (*p)->y);
-     addString(&msg, (*p)->sysName);
-     addString(&msg, (*p)->type);
+    if (p->second->clients.find(client)!=p->second->clients.end())
+      ids.push_back(p->first);
   }
-
-  addDWord(&msg, connections.size());
-  for(vector<TConnection*>::iterator p = connections.begin();
-      p != connections.end();
+  for(vector<int>::iterator p = ids.begin();
+      p != ids.end();
       ++p)
   {
-    addSDWord(&msg, (*p)->conn_id);
-    addSDWord(&msg, (*p)->id0);
-    addSDWord(&msg, (*p)->id1);
+    dropMap(client, *p);
   }
-  
-//  cout << "send map " << id << endl;
+}
+
+/**
+ * Send the next page of the map to the client.
+ *
+ * The transfer starts with a CMD_OPEN_MAP header, followed by
+ * CMD_MAP_SYMBOLS and CMD_MAP_CONNECTIONS pages of about MAP_PAGE_SIZE
+ * bytes each and a final CMD_MAP_END. The pages are skipped when the
+ * client's copy of the map has the current version.
+ *
+ * \return false when the transfer is complete
+ */
+bool
+TMap::sendPage(TClient *client, TMapTransfer *transfer)
+{
+  string msg;
+  addDWord(&msg, 0);
+  switch(transfer->phase) {
+    case TMapTransfer::HEADER:
+      LOG_DEBUG("sending map: " << symbols.size() << " symbols, "
+                << connections.size() << " connections");
+      addDWord(&msg, CMD_OPEN_MAP);
+      addSDWord(&msg, id);
+      addDWord(&msg, symbols.size());
+      addDWord(&msg, connections.size());
+      if (transfer->cached &&
+          transfer->epoch==epoch && transfer->version==revision())
+      {
+        LOG_DEBUG("client's copy of map " << id << " is up to date");
+        addDWord(&msg, 1);
+        transfer->phase = TMapTransfer::END;
+      } else {
+        addDWord(&msg, 0);
+        transfer->phase = TMapTransfer::SYMBOLS;
+      }
+      break;
+
+    case TMapTransfer::SYMBOLS: {
+      addDWord(&msg, CMD_MAP_SYMBOLS);
+      addSDWord(&msg, id);
+      addDWord(&msg, 0);
+      unsigned n = 0;
+      TSymbols::iterator p = symbols.lower_bound(transfer->next);
+      while(p!=symbols.end() && msg.size() < MAP_PAGE_SIZE) {
+        addSDWord(&msg, p->second->symbol_id);
+        addSDWord(&msg, p->second->objid);
+        addSDWord(&msg, p->second->x);
+        addSDWord(&msg, p->second->y);
+        addString(&msg, p->second->sysName);
+        addString(&msg, p->second->type);
+        ++n;
+        ++p;
+      }
+      setDWord(&msg, 12, n);
+      if (p!=symbols.end()) {
+        transfer->next = p->first;
+      } else {
+        transfer->phase = TMapTransfer::CONNECTIONS;
+        transfer->next = INT_MIN;
+      }
+    } break;
+
+    case TMapTransfer::CONNECTIONS: {
+      addDWord(&msg, CMD_MAP_CONNECTIONS);
+      addSDWord(&msg, id);
+      addDWord(&msg, 0);
+      unsigned n = 0;
+      TConnections::iterator p = connections.lower_bound(transfer->next);
+      while(p!=connections.end() && msg.size() < MAP_PAGE_SIZE) {
+        addSDWord(&msg, p->second->conn_id);
+        addSDWord(&msg, p->second->id0);
+        addSDWord(&msg, p->second->id1);
+        ++n;
+        ++p;
+      }
+      setDWord(&msg, 12, n);
+      if (p!=connections.end()) {
+        transfer->next = p->first;
+      } else {
+        transfer->phase = TMapTransfer::END;
+      }
+    } break;
+
+    case TMapTransfer::END:
+      addDWord(&msg, CMD_MAP_END);
+      addSDWord(&msg, id);
+      transfer->phase = TMapTransfer::DONE;
+      break;
 
+    case TMapTransfer::DONE:
+      return false;
+  }
   setDWord(&msg, 0, msg.size());
-  write(fd, msg.c_str(), msg.size());
+  client->send(msg, PRIORITY_BULK);
+  return transfer->phase != TMapTransfer::DONE;
+}
+
+/**
+ * Send an empty map in place of one which couldn't be loaded, so that
+ * the client doesn't wait for it.
+ *
+ * \return false when the transfer is complete
+ */
+bool
+TMap::sendRefused(TClient *client, TMapTransfer *transfer)
+{
+  string msg;
+  addDWord(&msg, 0);
+  switch(transfer->phase) {
+    case TMapTransfer::HEADER:
+      addDWord(&msg, CMD_OPEN_MAP);
+      addSDWord(&msg, transfer->map_id);
+      addDWord(&msg, 0); // symbols
+      addDWord(&msg, 0); // connections
+      addDWord(&msg, 0); // not up to date
+      transfer->phase = TMapTransfer::END;
+      break;
+    case TMapTransfer::END:
+      addDWord(&msg, CMD_MAP_END);
+      addSDWord(&msg, transfer->map_id);
+      transfer->phase = TMapTransfer::DONE;
+      break;
+    default:
+      return false;
+  }
+  setDWord(&msg, 0, msg.size());
+  client->send(msg, PRIORITY_BULK);
+  return transfer->phase != TMapTransfer::DONE;
 }
 
 
 int
-TMap::addSymbol(int client, int map, int sym, int dx, int dy)
+TMap::addSymbol(TClient *client, int map, int sym, int dx, int dy)
 {
   TMapMap::iterator p = mapmap.find(map);
   if (p==mapmap.end()) {
-    cout << "TMap::addSymbol: map " << map << " isn't active" << endl;
+    LOG_WARN("TMap::addSymbol: map " << map << " isn't active");
     return sym;
   }
   return p->second->addSymbol(client, sym, dx, dy);
 }
 
 int
-TMap::addSymbol(int clientfd, int symbol_id, int x, int y)
+TMap::addSymbol(TClient *client, int symbol_id, int x, int y)
 {
   // check id
   if (symbol_id>=0) {
-    cout << "TMap::addSymbol: device id isn't negative" << endl;
+    LOG_WARN("TMap::addSymbol: device id isn't negative");
     return id;
   }
 
+  // refuse by deleting the client's temporary symbol
+  if (full()) {
+    LOG_WARN("refused to add symbol to map " << id << ", maps use "
+             << allocated.total() << " bytes");
+    string cmd;
+    addDWord(&cmd, 16);
+    addDWord(&cmd, CMD_DELETE_SYMBOL);
+    addSDWord(&cmd, this->id);
+    addSDWord(&cmd, symbol_id);
+    client->send(cmd);
+    return symbol_id;
+  }
+
 //cout << "TMap::addSymbol("<<id<<","<<x<<","<<y<<")\n";
 
-  // allocate new id
+  // allocate new id (the smallest unused one)
   int new_id = 1;
-  for(vector<TSymbol*>::iterator p = symbols.begin();
-      p != symbols.end();
+  for(TSymbols::iterator p = symbols.begin();
+      p != symbols.end() && p->first <= new_id;
       ++p)
   {
-    if ((*p)->symbol_id == new_id) {
-      new_id = (*p)->symbol_id + 1;
-      p = symbols.begin() - 1;
-    }
+    if (p->first == new_id)
+      ++new_id;
   }
 
   // inform the client about the new id
@@ -327,10 +550,11 @@ TMap::addSymbol(int clientfd, int symbol_id, int x, int y)
   addSDWord(&cmd, this->id);  // map id
   addSDWord(&cmd, symbol_id); // old symbol id
   addSDWord(&cmd, new_id);    // new symbol id
-  write(clientfd, cmd.c_str(), cmd.size());
-cout << "send rename symbol " << id << " into " << new_id << endl;
+  client->send(cmd);
+  LOG_DEBUG("send rename symbol " << id << " into " << new_id);
   // store the new symbol
   addSymbol(new_id, 0, x, y, "unnamed", "unknown");
+  ++version;
   
   // inform other clients about the new symbol
   cmd.clear();
@@ -340,24 +564,29 @@ cout << "send rename symbol " << id << " into " << new_id << endl;
   addSDWord(&cmd, new_id);    // new symbol id
   addSDWord(&cmd, x);
   addSDWord(&cmd, y);
+  unsigned fanout = 0;
   for(set<TClient*>::iterator p = clients.begin();
       p != clients.end();
       ++p)
   {
-    if (clientfd == (*p)->fd)
+    // clients still receiving the map will get the symbol with the map
+    if (client == *p || (*p)->pendingSymbol(id, new_id))
       continue;
-    write((*p)->fd, cmd.c_str(), cmd.size());
+    (*p)->send(cmd);
+    ++fanout;
   }
+  stats.fanout.record(fanout);
   
   return new_id;
 }
 
 void
-TMap::deleteSymbol(int client, int map, int sym)
+TMap::deleteSymbol(TClient *client, int map, int sym)
 {
   TMapMap::iterator p = mapmap.find(map);
   if (p==mapmap.end()) {
-    cout << "TMap::deleteSymbol: map " << map << " isn't active" << endl;
+    LOG_WARN("TMap::deleteSymbol: map " << map << " isn't active");
+    return;
   }
   p->second->deleteSymbol(client, sym);
 }
@@ -365,20 +594,18 @@ TMap::deleteSymbol(int client, int map, int sym)
 #warning "id problem from add is repeated in delete code but unhandled"
 
 void
-TMap::deleteSymbol(int clientfd, int id)
+TMap::deleteSymbol(TClient *client, int id)
 {
-cout << "TMap::deleteSymbol("<<id<<")\n";
-
-  for(vector<TSymbol*>::iterator p = symbols.begin();
-      p != symbols.end();
-      ++p)
-  {
-    if ((*p)->symbol_id == id) {
-      delete *p;
-      symbols.erase(p);
-      break;
-    }
+  LOG_DEBUG("TMap::deleteSymbol("<<id<<")");
+
+  TSymbols::iterator p = symbols.find(id);
+  if (p!=symbols.end()) {
+    release(symbolMemory(p->second));
+    grid.erase(p->second);
+    delete p->second;
+    symbols.erase(p);
   }
+  ++version;
 
   string cmd;
   addDWord(&cmd, 16);
@@ -386,29 +613,32 @@ cout << "TMap::deleteSymbol("<<id<<")\n";
   addSDWord(&cmd, this->id);  // map id
   addSDWord(&cmd, id);        // symbol id
 
+  unsigned fanout = 0;
   for(set<TClient*>::iterator p = clients.begin();
       p != clients.end();
       ++p)
   {
-    if (clientfd == (*p)->fd)
+    if (client == *p || (*p)->pendingSymbol(this->id, id))
       continue;
-    write((*p)->fd, cmd.c_str(), cmd.size());
+    (*p)->send(cmd);
+    ++fanout;
   }
+  stats.fanout.record(fanout);
 }
 
 void
-TMap::translateSymbol(int client, int map, int sym, int dx, int dy)
+TMap::translateSymbol(TClient *client, int map, int sym, int dx, int dy)
 {
   TMapMap::iterator p = mapmap.find(map);
   if (p==mapmap.end()) {
-    cout << "TMap::translateSymbol: map " << map << " isn't active" << endl;
+    LOG_WARN("TMap::translateSymbol: map " << map << " isn't active");
     return;
   }
   p->second->translateSymbol(client, sym, dx, dy);
 }
 
 void
-TMap::translateSymbol(int clientfd, int sym, int dx, int dy)
+TMap::translateSymbol(TClient *client, int sym, int dx, int dy)
 {
   string cmd;
   addDWord(&cmd, 24);   
@@ -417,59 +647,107 @@ TMap::translateSymbol(int clientfd, int sym, int dx, int dy)
   addSDWord(&cmd, sym);
   addSDWord(&cmd, dx);
   addSDWord(&cmd, dy);
+  unsigned fanout = 0;
   for(set<TClient*>::iterator p = clients.begin();
       p != clients.end();
       ++p)
   {
-    if (clientfd == (*p)->fd)
+    if (client == *p || (*p)->pendingSymbol(id, sym))
       continue;
-    write((*p)->fd, cmd.c_str(), cmd.size());
+    (*p)->send(cmd);
+    ++fanout;
   }
+  stats.fanout.record(fanout);
   
-  for(vector<TSymbol*>::iterator p = symbols.begin();
-      p != symbols.end();
+  TSymbols::iterator p = symbols.find(sym);
+  if (p!=symbols.end()) {
+    TSymbol *s = p->second;
+    int ox = s->x, oy = s->y;
+    s->x += dx;
+    s->y += dy;
+    grid.move(s, ox, oy);
+  }
+  ++version;
+}
+
+void
+TMap::queryRegion(TClient *client, int map, int x, int y, int w, int h)
+{
+  TMapMap::iterator p = mapmap.find(map);
+  if (p==mapmap.end()) {
+    LOG_WARN("TMap::queryRegion: map " << map << " isn't active");
+    return;
+  }
+  p->second->queryRegion(client, x, y, w, h);
+}
+
+/**
+ * Send the ids of all symbols within the given rectangle to the client.
+ */
+void
+TMap::queryRegion(TClient *client, int x, int y, int w, int h)
+{
+  vector<TSymbol*> found;
+  grid.find(x, y, w, h, &found);
+
+  string cmd;
+  addDWord(&cmd, 0);
+  addDWord(&cmd, CMD_QUERY_REGION);
+  addSDWord(&cmd, id);
+  addDWord(&cmd, found.size());
+  for(vector<TSymbol*>::iterator p = found.begin();
+      p != found.end();
       ++p)
   {
-    if ((*p)->symbol_id == sym) {
-      (*p)->x += dx;
-      (*p)->y += dy;
-      break;
-    }
+    addSDWord(&cmd, (*p)->symbol_id);
   }
+  setDWord(&cmd, 0, cmd.size());
+  client->send(cmd, PRIORITY_BULK);
 }
 
 int
-TMap::addConnection(int client, int map, int conn_id, int sym0, int sym1)
+TMap::addConnection(TClient *client, int map, int conn_id, int sym0, int sym1)
 {
   TMapMap::iterator p = mapmap.find(map);
   if (p==mapmap.end()) {
-    cout << "TMap::addConnection: map " << map << " isn't active" << endl;
+    LOG_WARN("TMap::addConnection: map " << map << " isn't active");
     return conn_id;
   }
   return p->second->addConnection(client, conn_id, sym0, sym1);
 }
 
 int
-TMap::addConnection(int clientfd, int conn_id, int sym0, int sym1)
+TMap::addConnection(TClient *client, int conn_id, int sym0, int sym1)
 {
   // check id
   if (conn_id>=0) {
-    cout << "TMap::addConnection: conn_id id isn't negative" << endl;
+    LOG_WARN("TMap::addConnection: conn_id id isn't negative");
+    return conn_id;
+  }
+
+  // refuse by deleting the client's temporary connection
+  if (full()) {
+    LOG_WARN("refused to add connection to map " << id << ", maps use "
+             << allocated.total() << " bytes");
+    string cmd;
+    addDWord(&cmd, 16);
+    addDWord(&cmd, CMD_DELETE_CONNECTION);
+    addSDWord(&cmd, this->id);
+    addSDWord(&cmd, conn_id);
+    client->send(cmd);
     return conn_id;
   }
 
 //cout << "TMap::addSymbol("<<id<<","<<x<<","<<y<<")\n";
 
-  // allocate new id
+  // allocate new id (the smallest unused one)
   int new_id = 1;
-  for(vector<TConnection*>::iterator p = connections.begin();
-      p != connections.end();
+  for(TConnections::iterator p = connections.begin();
+      p != connections.end() && p->first <= new_id;
       ++p)
   {
-    if ((*p)->conn_id == new_id) {
-      new_id = (*p)->conn_id + 1;
-      p = connections.begin() - 1;
-    }
+    if (p->first == new_id)
+      ++new_id;
   }
 
   // inform the client about the new id
@@ -479,10 +757,11 @@ TMap::addConnection(int clientfd, int conn_id, int sym0, int sym1)
   addSDWord(&cmd, this->id);  // map id
   addSDWord(&cmd, conn_id);   // old symbol id
   addSDWord(&cmd, new_id);    // new symbol id
-  write(clientfd, cmd.c_str(), cmd.size());
-cout << "send rename connection " << conn_id << " into " << new_id << endl;
+  client->send(cmd);
+  LOG_DEBUG("send rename connection " << conn_id << " into " << new_id);
   // store the new symbol
   addConnection(new_id, sym0, sym1);
+  ++version;
   
   // inform other clients about the new symbol
   cmd.clear();
@@ -493,24 +772,28 @@ cout << "send rename connection " << conn_id << " into " << new_id << endl;
 #warning "reverse mapping of IDs may be required..."
   addSDWord(&cmd, sym0);
   addSDWord(&cmd, sym1);
+  unsigned fanout = 0;
   for(set<TClient*>::iterator p = clients.begin();
       p != clients.end();
       ++p)
   {
-    if (clientfd == (*p)->fd)
+    if (client == *p || (*p)->pendingConnection(id, new_id))
       continue;
-    write((*p)->fd, cmd.c_str(), cmd.size());
+    (*p)->send(cmd);
+    ++fanout;
   }
+  stats.fanout.record(fanout);
   
   return new_id;
 }
 
 void
-TMap::deleteConnection(int client, int map, int conn)
+TMap::deleteConnection(TClient *client, int map, int conn)
 {
   TMapMap::iterator p = mapmap.find(map);
   if (p==mapmap.end()) {
-    cout << "TMap::deleteConnection: map " << map << " isn't active" << endl;
+    LOG_WARN("TMap::deleteConnection: map " << map << " isn't active");
+    return;
   }
   p->second->deleteConnection(client, conn);
 }
@@ -518,20 +801,17 @@ TMap::deleteConnection(int client, int map, int conn)
 #warning "id problem from add is repeated in delete code but unhandled"
 
 void
-TMap::deleteConnection(int clientfd, int id)
+TMap::deleteConnection(TClient *client, int id)
 {
-cout << "TMap::deleteConnection("<<id<<")\n";
+  LOG_DEBUG("TMap::deleteConnection("<<id<<")");
 
-  for(vector<TSymbol*>::iterator p = symbols.begin();
-      p != symbols.end();
-      ++p)
-  {
-    if ((*p)->symbol_id == id) {
-      delete *p;
-      symbols.erase(p);
-      break;
-    }
+  TConnections::iterator p = connections.find(id);
+  if (p!=connections.end()) {
+    release(connectionMemory(p->second));
+    delete p->second;
+    connections.erase(p);
   }
+  ++version;
 
   string cmd;
   addDWord(&cmd, 16);
@@ -539,12 +819,15 @@ cout << "TMap::deleteConnection("<<id<<")\n";
   addSDWord(&cmd, this->id);  // map id
   addSDWord(&cmd, id);        // symbol id
 
+  unsigned fanout = 0;
   for(set<TClient*>::iterator p = clients.begin();
       p != clients.end();
       ++p)
   {
-    if (clientfd == (*p)->fd)
+    if (client == *p || (*p)->pendingConnection(this->id, id))
       continue;
-    write((*p)->fd, cmd.c_str(), cmd.size());
+    (*p)->send(cmd);
+    ++fanout;
   }
+  stats.fanout.record(fanout);
 }
@@ -18,8 +18,11 @@
  */
 
 #ifndef __NETEDITD_MAP_HH
+#define __NETEDITD_MAP_HH
 
 #include "client.hh"
+#include "grid.hh"
+#include "memory.hh"
 #include <map>
 #include <set>
 #include <vector>
@@ -31,15 +34,24 @@ using namespace std;
 
 class TMap
 {
-  typedef map<int, TMap*> TMapMap;
-  static TMapMap mapmap;
+  public:
+    typedef map<int, TMap*> TMapMap;
+  private:
+    static TMapMap mapmap;
+    typedef map<int, unsigned> TVersions; // map_id -> version
+    static TVersions versions;            // of the maps not loaded
 
   public:
+    TMap() { version = 0; loadednodes = nodes; }
     ~TMap();
   
     int id;
     static TMap* load(int map_id);
-    void send(int fd);
+    static TMap* find(int map_id);
+    static size_t count() { return mapmap.size(); }
+    static const TMapMap& all() { return mapmap; }
+    bool sendPage(TClient *client, TMapTransfer *transfer);
+    static bool sendRefused(TClient *client, TMapTransfer *transfer);
     
     struct TSymbol {
       int symbol_id;
@@ -48,41 +60,69 @@ class TMap
       string sysName;
       string type;
     };
-    vector<TSymbol*> symbols;
-    
+    typedef map<int, TSymbol*> TSymbols; // symbol_id -> symbol
+    TSymbols symbols;
+    GGrid<TSymbol> grid;                 // symbols by position
                    
     struct TConnection {
       int conn_id;
       int id0, id1;
     };
-    vector<TConnection*> connections;
+    typedef map<int, TConnection*> TConnections; // conn_id -> connection
+    TConnections connections;
+
+    // the version is increased with every change and kept when the map
+    // is unloaded, the epoch tells the versions of different runs apart
+    unsigned version;
+    static const unsigned epoch;
+
+    // the names and types of the symbols come from the nodes, so a
+    // change to any node also changes the revision of every map
+    static unsigned nodes;
+    unsigned loadednodes; // 'nodes' when the map was read from the DBMS
+    unsigned revision() const { return version + nodes; }
+
+    TMapMemory memory;           // held by this map
+    static TMapMemory allocated; // held by all maps
+    static bool full() {
+      return memorylimits.maps && allocated.total() >= memorylimits.maps;
+    }
 
     // list of clients using this map
     // (used to distribute changes to all clients and to copy the map
     // back to the DBMS when no client is using it anymore)
     set<TClient*> clients;
     
-    static int addSymbol(int clientfd, int map, int sym, int x, int y);
-    int addSymbol(int clientfd, int sym, int x, int y);
+    static int addSymbol(TClient *client, int map, int sym, int x, int y);
+    int addSymbol(TClient *client, int sym, int x, int y);
 
-    static void deleteSymbol(int clientfd, int map, int sym);
-    void deleteSymbol(int clientfd, int sym);
+    static void deleteSymbol(TClient *client, int map, int sym);
+    void deleteSymbol(TClient *client, int sym);
     
-    static void translateSymbol(int clientfd, int map, int sym, int dx, int dy);
-    void translateSymbol(int clientfd, int sym, int dx, int dy);
+    static void translateSymbol(TClient *client, int map, int sym, int dx, int dy);
+    void translateSymbol(TClient *client, int sym, int dx, int dy);
 
-    static int addConnection(int clientfd, int map, int conn_id, int sym0, int sym1);
-    int addConnection(int map, int conn_id, int sym0, int sym1);
+    static void queryRegion(TClient *client, int map, int x, int y, int w, int h);
+    void queryRegion(TClient *client, int x, int y, int w, int h);
 
-    static void deleteConnection(int clientfd, int map, int conn);
-    void deleteConnection(int clientfd, int conn);
+    static int addConnection(TClient *client, int map, int conn_id, int sym0, int sym1);
+    int addConnection(TClient *client, int conn_id, int sym0, int sym1);
+
+    static void deleteConnection(TClient *client, int map, int conn);
+    void deleteConnection(TClient *client, int conn);
 
     static void dropMap(TClient*, int map);
+    static void closeClient(TClient*);
 
   private:
+    // approximate size of the pages in which maps are sent
+    static const unsigned MAP_PAGE_SIZE = 32768;
+
     // utility methods
     void addSymbol(int symbol_id, int objid, int x, int y, const string &name, const string &type);
     void addConnection(int conn_id, int id0, int id1);
+    void allocate(const TMapMemory &m);
+    void release(const TMapMemory &m);
 };
 
 } // namespace netedit
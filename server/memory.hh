@@ -0,0 +1,109 @@
+/*
+ * NetEdit -- A network management tool
+ * Copyright (C) 2003-2006 by Mark-André Hopf <mhopf@mark13.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __NETEDITD_MEMORY_HH
+#define __NETEDITD_MEMORY_HH
+
+#include <stddef.h>
+#include <string>
+
+namespace netedit {
+
+using namespace std;
+
+/**
+ * Estimates of the heap memory held by maps, nodes and clients.
+ *
+ * The objects, the buffers of their strings and the nodes of the
+ * containers holding them are counted as laid out by libstdc++. The
+ * overhead of malloc isn't, so the sum stays below the server's RSS.
+ */
+
+// bytes per element of a std::map or std::set besides the value
+static const size_t TREE_NODE = 4 * sizeof(void*);
+
+/**
+ * Bytes allocated for the characters of 's'. Short strings are kept
+ * within the object.
+ */
+inline size_t
+memoryOf(const string &s)
+{
+  return s.capacity() > 15 ? s.capacity() + 1 : 0;
+}
+
+/**
+ * Memory held by a map.
+ */
+struct TMapMemory
+{
+  TMapMemory() {
+    symbols = connections = strings = 0;
+  }
+  size_t symbols;      // TSymbol, the index entry and the grid entry
+  size_t connections;  // TConnection and the index entry
+  size_t strings;      // names and types of the symbols
+  size_t total() const { return symbols + connections + strings; }
+  void operator+=(const TMapMemory &m) {
+    symbols += m.symbols;
+    connections += m.connections;
+    strings += m.strings;
+  }
+  void operator-=(const TMapMemory &m) {
+    symbols -= m.symbols;
+    connections -= m.connections;
+    strings -= m.strings;
+  }
+};
+
+/**
+ * Memory held by a client.
+ */
+struct TClientMemory
+{
+  TClientMemory() {
+    input = mappings = output = 0;
+  }
+  size_t input;        // received data not yet executed
+  size_t mappings;     // temporary ids of symbols and connections
+  size_t output;       // queued messages and map transfers
+  size_t total() const { return input + mappings + output; }
+};
+
+/**
+ * Limits set on the command line, 0 for no limit.
+ *
+ * Maps and nodes exceeding their limit aren't loaded and maps don't
+ * grow any further. Clients exceeding theirs are disconnected.
+ */
+struct TMemoryLimits
+{
+  TMemoryLimits() {
+    maps = nodes = client = 0;
+  }
+  size_t maps;    // all maps held in memory
+  size_t nodes;   // all nodes in the node cache
+  size_t client;  // input buffer and output queues of a single client
+};
+
+extern TMemoryLimits memorylimits;
+
+} // namespace netedit
+
+#endif
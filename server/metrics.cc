@@ -0,0 +1,301 @@
+/*
+ * NetEdit -- A network management tool
+ * Copyright (C) 2003-2006 by Mark-André Hopf <mhopf@mark13.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "metrics.hh"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <iostream>
+
+extern netedit::TTimerWheel timerwheel;
+
+using namespace netedit;
+
+// a scrape must complete within this time (milliseconds)
+static const unsigned METRICS_TIMEOUT = 10000;
+static const unsigned METRICS_MAX_CONNECTIONS = 8;
+static const size_t METRICS_MAX_REQUEST = 4096;
+
+TMetricsServer::TMetricsServer(TCollector collector)
+{
+  this->collector = collector;
+  sock = -1;
+}
+
+TMetricsServer::~TMetricsServer()
+{
+  while(!connections.empty())
+    close(connections.back());
+  for(TConnections::iterator p = idle.begin(); p != idle.end(); ++p)
+    delete *p;
+  if (sock!=-1)
+    ::close(sock);
+}
+
+/**
+ * Listen on 127.0.0.1 at 'port'.
+ */
+bool
+TMetricsServer::listen(unsigned port)
+{
+  sock = socket(AF_INET, SOCK_STREAM, 0);
+  if (sock==-1) {
+    perror("while creating metrics socket");
+    return false;
+  }
+
+  int yes = 1;
+  if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int))<0) {
+    perror("failed to set SO_REUSEADDR");
+  }
+
+  sockaddr_in name;
+  name.sin_family      = AF_INET;
+  name.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  name.sin_port        = htons(port);
+  if (bind(sock, (sockaddr*) &name, sizeof(sockaddr_in)) < 0) {
+    perror("while binding to metrics socket");
+    ::close(sock);
+    sock = -1;
+    return false;
+  }
+  if (::listen(sock, 4)==-1) {
+    perror("while starting to listen on metrics socket");
+    ::close(sock);
+    sock = -1;
+    return false;
+  }
+  fcntl(sock, F_SETFL, O_NONBLOCK);
+  return true;
+}
+
+void
+TMetricsServer::setFDs(fd_set *rd, fd_set *wr, int *max)
+{
+  if (sock==-1)
+    return;
+  if (connections.size() < METRICS_MAX_CONNECTIONS) {
+    FD_SET(sock, rd);
+    if (sock>=*max)
+      *max = sock+1;
+  }
+  for(TConnections::iterator p = connections.begin();
+      p != connections.end();
+      ++p)
+  {
+    if ((*p)->out.empty())
+      FD_SET((*p)->fd, rd);
+    else
+      FD_SET((*p)->fd, wr);
+    if ((*p)->fd>=*max)
+      *max = (*p)->fd+1;
+  }
+}
+
+void
+TMetricsServer::handle(fd_set *rd, fd_set *wr)
+{
+  if (sock==-1)
+    return;
+  // iterate backwards as close() removes the connection from the list
+  for(size_t i=connections.size(); i>0; --i) {
+    TConnection *c = connections[i-1];
+    bool ok = true;
+    if (FD_ISSET(c->fd, rd))
+      ok = read(c);
+    else if (FD_ISSET(c->fd, wr))
+      ok = write(c);
+    if (!ok)
+      close(c);
+  }
+  if (FD_ISSET(sock, rd))
+    accept();
+}
+
+void
+TMetricsServer::accept()
+{
+  while(connections.size() < METRICS_MAX_CONNECTIONS) {
+    int fd = ::accept(sock, NULL, NULL);
+    if (fd<0) {
+      if (errno!=EAGAIN && errno!=EINTR)
+        perror("accept on metrics socket");
+      return;
+    }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    TConnection *c;
+    if (idle.empty()) {
+      c = new TConnection;
+      c->server = this;
+    } else {
+      c = idle.back();
+      idle.pop_back();
+    }
+    c->fd = fd;
+    c->in.clear();
+    c->out.clear();
+    c->outpos = 0;
+    connections.push_back(c);
+    timerwheel.add(c, METRICS_TIMEOUT);
+  }
+}
+
+/**
+ * \return false when the connection is to be closed
+ */
+bool
+TMetricsServer::read(TConnection *c)
+{
+  char buffer[1024];
+  ssize_t n = ::read(c->fd, buffer, sizeof(buffer));
+  if (n<0)
+    return errno==EAGAIN || errno==EINTR;
+  if (n==0)
+    return false;
+  c->in.append(buffer, n);
+  if (c->in.find("\r\n\r\n")!=string::npos ||
+      c->in.find("\n\n")!=string::npos)
+  {
+    respond(c);
+    return write(c);
+  }
+  return c->in.size() < METRICS_MAX_REQUEST;
+}
+
+bool
+TMetricsServer::write(TConnection *c)
+{
+  while(c->outpos < c->out.size()) {
+    ssize_t n = ::write(c->fd, c->out.c_str() + c->outpos,
+                        c->out.size() - c->outpos);
+    if (n<0) {
+      if (errno==EINTR)
+        continue;
+      return errno==EAGAIN;
+    }
+    c->outpos += n;
+  }
+  // the response is complete
+  return false;
+}
+
+void
+TMetricsServer::respond(TConnection *c)
+{
+  const char *status = "200 OK";
+  body.clear();
+  if (c->in.compare(0, 13, "GET /metrics ")==0 ||
+      c->in.compare(0, 6, "GET / ")==0)
+  {
+    collector(this);
+  } else {
+    status = "404 Not Found";
+    body = "not found\n";
+  }
+
+  char header[256];
+  snprintf(header, sizeof(header),
+           "HTTP/1.0 %s\r\n"
+           "Content-Type: text/plain; version=0.0.4\r\n"
+           "Content-Length: %lu\r\n"
+           "Connection: close\r\n"
+           "\r\n",
+           status, (unsigned long)body.size());
+  c->out = header;
+  c->out += body;
+  c->outpos = 0;
+}
+
+void
+TMetricsServer::close(TConnection *c)
+{
+  c->cancel();
+  ::close(c->fd);
+  for(TConnections::iterator p = connections.begin();
+      p != connections.end();
+      ++p)
+  {
+    if (*p==c) {
+      connections.erase(p);
+      break;
+    }
+  }
+  idle.push_back(c);
+}
+
+void
+TMetricsServer::TConnection::expired()
+{
+  server->close(this);
+}
+
+void
+TMetricsServer::metric(const char *name, const char *type, const char *help)
+{
+  body += "# HELP ";
+  body += name;
+  body += ' ';
+  body += help;
+  body += "\n# TYPE ";
+  body += name;
+  body += ' ';
+  body += type;
+  body += '\n';
+}
+
+void
+TMetricsServer::sample(const char *name, const char *labels, double value)
+{
+  char line[256];
+  if (labels && *labels)
+    snprintf(line, sizeof(line), "%s{%s} %.9g\n", name, labels, value);
+  else
+    snprintf(line, sizeof(line), "%s %.9g\n", name, value);
+  body += line;
+}
+
+/**
+ * Write a histogram as summary with the 0.5, 0.99 and 0.999 quantiles,
+ * values are multiplied with 'scale', e.g. to convert microseconds
+ * into seconds.
+ */
+void
+TMetricsServer::summary(const char *name, const char *labels,
+                        const THistogram &h, double scale)
+{
+  static const char *quantile[] = { "0.5", "0.99", "0.999" };
+  static const double percent[] = { 50.0, 99.0, 99.9 };
+  char buffer[256];
+  for(unsigned i=0; i<3; ++i) {
+    snprintf(buffer, sizeof(buffer), "%s%squantile=\"%s\"",
+             labels ? labels : "", labels && *labels ? "," : "", quantile[i]);
+    sample(name, buffer, h.percentile(percent[i]) * scale);
+  }
+  snprintf(buffer, sizeof(buffer), "%s_sum", name);
+  sample(buffer, labels, h.mean() * h.count() * scale);
+  snprintf(buffer, sizeof(buffer), "%s_count", name);
+  sample(buffer, labels, h.count());
+}
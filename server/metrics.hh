@@ -0,0 +1,89 @@
+/*
+ * NetEdit -- A network management tool
+ * Copyright (C) 2003-2006 by Mark-André Hopf <mhopf@mark13.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __NETEDITD_METRICS_HH
+#define __NETEDITD_METRICS_HH
+
+#include "timerwheel.hh"
+#include "../lib/histogram.hh"
+
+#include <sys/select.h>
+#include <string>
+#include <vector>
+
+namespace netedit {
+
+using namespace std;
+
+/**
+ * A minimal HTTP server on 127.0.0.1 which answers requests for
+ * /metrics with the Prometheus text exposition format.
+ *
+ * All sockets are non-blocking and handled by the server's select()
+ * loop. The output buffers are reused between requests, only the
+ * number of connections is limited and idle connections are closed
+ * after a few seconds.
+ */
+class TMetricsServer
+{
+  public:
+    typedef void (*TCollector)(TMetricsServer*);
+
+    TMetricsServer(TCollector collector);
+    ~TMetricsServer();
+
+    bool listen(unsigned port);
+    void setFDs(fd_set *rd, fd_set *wr, int *max);
+    void handle(fd_set *rd, fd_set *wr);
+
+    // used by the collector to write the metrics
+    void metric(const char *name, const char *type, const char *help);
+    void sample(const char *name, const char *labels, double value);
+    void summary(const char *name, const char *labels,
+                 const THistogram &h, double scale = 1.0);
+
+  private:
+    struct TConnection:
+      public TTimer
+    {
+      TMetricsServer *server;
+      int fd;
+      string in;
+      string out;
+      size_t outpos;
+      void expired();
+    };
+    typedef vector<TConnection*> TConnections;
+
+    TCollector collector;
+    int sock;
+    TConnections connections;
+    TConnections idle;        // closed connections kept for reuse
+    string body;
+
+    void accept();
+    bool read(TConnection*);
+    bool write(TConnection*);
+    void respond(TConnection*);
+    void close(TConnection*);
+};
+
+} // namespace netedit
+
+#endif
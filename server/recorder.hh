@@ -0,0 +1,143 @@
+/*
+ * NetEdit -- A network management tool
+ * Copyright (C) 2003-2006 by Mark-André Hopf <mhopf@mark13.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __NETEDITD_RECORDER_HH
+#define __NETEDITD_RECORDER_HH
+
+#include "../lib/common.hh"
+#include "../lib/binary.hh"
+#include "../lib/session.hh"
+#include "../lib/log.hh"
+#include "stats.hh"
+
+#include <sys/time.h>
+#include <stdio.h>
+#include <time.h>
+#include <string>
+
+namespace netedit {
+
+using namespace std;
+
+/**
+ * Writes the messages received from a client into a session recording
+ * (see lib/session.hh) for neteditreplay.
+ *
+ * Records are buffered by stdio, so recording costs a copy per message
+ * and a write() every 64KB. When writing fails the recording stops but
+ * the session continues.
+ */
+class TSessionRecorder
+{
+    FILE *file;
+    unsigned long long start;
+    char buffer[65536];
+
+    TSessionRecorder() {}
+
+  public:
+    static TSessionRecorder* open(const char *dir, const string &peer);
+    ~TSessionRecorder() {
+      if (file)
+        fclose(file);
+    }
+
+    void record(const string &msg, size_t n);
+
+  protected:
+    bool write(const string &data) {
+      if (fwrite(data.c_str(), 1, data.size(), file)==data.size())
+        return true;
+      LOG_ERROR("session recording failed, stopped recording");
+      fclose(file);
+      file = 0;
+      return false;
+    }
+};
+
+/**
+ * Create a new recording in directory 'dir' for a client connected
+ * from 'peer', returns NULL on failure.
+ */
+inline TSessionRecorder*
+TSessionRecorder::open(const char *dir, const string &peer)
+{
+  static unsigned sequence = 0;
+
+  timeval tv;
+  gettimeofday(&tv, NULL);
+  tm t;
+  localtime_r(&tv.tv_sec, &t);
+  char name[1024];
+  snprintf(name, sizeof(name), "%s/%04d%02d%02d-%02d%02d%02d-%u.session",
+           dir, t.tm_year+1900, t.tm_mon+1, t.tm_mday,
+           t.tm_hour, t.tm_min, t.tm_sec, ++sequence);
+  FILE *file = fopen(name, "w");
+  if (!file) {
+    LOG_ERROR("failed to create session recording '" << name << "'");
+    return 0;
+  }
+
+  TSessionRecorder *recorder = new TSessionRecorder;
+  recorder->file = file;
+  recorder->start = TServerStats::clock();
+  setvbuf(file, recorder->buffer, _IOFBF, sizeof(recorder->buffer));
+
+  string header;
+  addDWord(&header, SESSION_MAGIC);
+  addDWord(&header, SESSION_VERSION);
+  addQWord(&header, (unsigned long long)tv.tv_sec * 1000000 + tv.tv_usec);
+  addString(&header, peer);
+  if (!recorder->write(header)) {
+    delete recorder;
+    return 0;
+  }
+  LOG_INFO("recording session into '" << name << "'");
+  return recorder;
+}
+
+/**
+ * Record the first 'n' bytes of 'msg', which hold a complete message.
+ */
+inline void
+TSessionRecorder::record(const string &msg, size_t n)
+{
+  if (!file)
+    return;
+  string data;
+  addQWord(&data, TServerStats::clock() - start);
+  unsigned p = 4;
+  if (n>=8 && getDWord(msg, &p)==CMD_LOGIN) {
+    // keep the login but drop the password
+    string login;
+    addDWord(&login, 0);
+    addDWord(&login, CMD_LOGIN);
+    addString(&login, getString(msg, &p));
+    addString(&login, "");
+    setDWord(&login, 0, login.size());
+    data += login;
+  } else {
+    data.append(msg, 0, n);
+  }
+  write(data);
+}
+
+} // namespace netedit
+
+#endif
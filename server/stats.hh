@@ -0,0 +1,312 @@
+/*
+ * NetEdit -- A network management tool
+ * Copyright (C) 2003-2006 by Mark-André Hopf <mhopf@mark13.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __NETEDITD_STATS_HH
+#define __NETEDITD_STATS_HH
+
+#include "../lib/common.hh"
+#include "../lib/binary.hh"
+#include "../lib/histogram.hh"
+#include "../lib/log.hh"
+
+#include <stdio.h>
+#include <time.h>
+#include <string>
+#include <map>
+#include <iostream>
+
+namespace netedit {
+
+using namespace std;
+
+/**
+ * Figures recorded per protocol command.
+ */
+struct TCommandStats
+{
+  TCommandStats() {
+    count = bytes_in = bytes_out = 0;
+  }
+  unsigned long long count;
+  unsigned long long bytes_in;
+  unsigned long long bytes_out;  // replies and broadcasts caused by the command
+  THistogram latency;            // processing time in microseconds
+};
+
+/**
+ * Figures recorded per SQL statement site.
+ */
+struct TSQLStats
+{
+  TSQLStats() {
+    slow = 0;
+  }
+  THistogram time;               // microseconds per execution
+  THistogram rows;               // rows fetched or affected per execution
+  unsigned long long slow;       // executions which exceeded --slow-sql
+};
+
+/**
+ * Statistics of the server.
+ *
+ * The server is single threaded, so all figures are recorded without
+ * any locking.
+ */
+class TServerStats
+{
+  public:
+    static const unsigned COMMANDS = 64;
+
+    // index 0 collects unknown commands and messages which weren't
+    // caused by a command, like expired locks
+    TCommandStats command[COMMANDS];
+
+    unsigned current;              // index of the command being executed
+    THistogram fanout;             // number of clients receiving a broadcast
+    THistogram loop;               // time spent per event loop iteration
+    typedef map<string, TSQLStats> TSQLSites;
+    TSQLSites sql;                 // per SQL statement site
+    unsigned long long slowsql;    // log statements slower than this (us)
+    time_t started;
+
+    TServerStats() {
+      current = 0;
+      slowsql = 0;
+      started = time(NULL);
+    }
+
+    static unsigned long long clock() {
+      timespec t;
+      clock_gettime(CLOCK_MONOTONIC, &t);
+      return (unsigned long long)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+    }
+
+    void begin(unsigned cmd) {
+      current = cmd < COMMANDS ? cmd : 0;
+    }
+    void end(size_t bytes_in, unsigned long long start) {
+      TCommandStats &s = command[current];
+      ++s.count;
+      s.bytes_in += bytes_in;
+      s.latency.record(clock() - start);
+      current = 0;
+    }
+    void sent(size_t n) {
+      command[current].bytes_out += n;
+    }
+
+    void encode(string *out, unsigned clients) const;
+    void print(ostream &out, unsigned clients) const;
+
+  protected:
+    static void encode(string *out, const THistogram &h);
+    static void print(ostream &out, const char *name, const THistogram &h);
+};
+
+extern TServerStats stats;
+
+/**
+ * Measures the time spent at a SQL statement site and the number of
+ * rows it returned or modified.
+ *
+ *   TSQLTimer sqltimer("load node");
+ *   sqltimer.param("node_id", id);
+ *   EXEC SQL SELECT ... WHERE node_id = :id;
+ *   sqltimer.rows(sqlca.sqlerrd[2]);
+ *   sqltimer.stop();
+ *
+ * Cursors call row() after each FETCH instead. Executions taking longer
+ * than stats.slowsql are logged together with their parameters, which
+ * are only formatted then. Statements executed in a loop look up their
+ * site once and call restart() for each execution.
+ */
+class TSQLTimer
+{
+    const char *site;
+    TSQLStats *figures;
+    bool running;
+    unsigned long long start;
+    unsigned long long count;
+    static const unsigned PARAMS = 4;
+    struct {
+      const char *name;
+      long long value;
+    } params[PARAMS];
+    unsigned nparams;
+
+    string formatParams() const {
+      string s;
+      char buffer[80];
+      for(unsigned i=0; i<nparams; ++i) {
+        snprintf(buffer, sizeof(buffer), "%s%s=%lld",
+                 i ? ", " : "", params[i].name, params[i].value);
+        s += buffer;
+      }
+      return s;
+    }
+
+  public:
+    TSQLTimer(const char *site) {
+      this->site = site;
+      figures = &stats.sql[site];
+      restart();
+    }
+    void restart() {
+      running = true;
+      count = 0;
+      nparams = 0;
+      start = TServerStats::clock();
+    }
+    void param(const char *name, long long value) {
+      if (nparams >= PARAMS)
+        return;
+      params[nparams].name  = name;
+      params[nparams].value = value;
+      ++nparams;
+    }
+    void row() { ++count; }
+    void rows(long n) {
+      if (n>0)
+        count += n;
+    }
+    void stop() {
+      if (!running)
+        return;
+      unsigned long long elapsed = TServerStats::clock() - start;
+      figures->time.record(elapsed);
+      figures->rows.record(count);
+      if (stats.slowsql && elapsed >= stats.slowsql) {
+        ++figures->slow;
+        LOG_WARN("slow SQL statement '" << site << "': " << elapsed
+                 << "us, " << count << " rows (" << formatParams() << ")");
+      }
+      running = false;
+    }
+};
+
+inline void
+TServerStats::encode(string *out, const THistogram &h)
+{
+  addQWord(out, h.count());
+  addQWord(out, h.percentile(50.0));
+  addQWord(out, h.percentile(99.0));
+  addQWord(out, h.percentile(99.9));
+  addQWord(out, h.max());
+}
+
+/**
+ * Append the CMD_GET_STATS reply to 'out':
+ *
+ *   dword uptime in seconds, dword number of clients,
+ *   dword n, n times: dword command, qword count, qword bytes in,
+ *                     qword bytes out, histogram of the latency
+ *   histogram of the fan-out
+ *   dword m, m times: string SQL site, histogram of the time,
+ *                     histogram of the rows, qword slow executions
+ *
+ * with histogram being qword count, p50, p99, p999 and max. Times are
+ * in microseconds. neteditd appends the memory figures, see
+ * encodeMemory() in main.cc.
+ */
+inline void
+TServerStats::encode(string *out, unsigned clients) const
+{
+  addDWord(out, time(NULL) - started);
+  addDWord(out, clients);
+  unsigned n = 0;
+  for(unsigned i=0; i<COMMANDS; ++i) {
+    if (command[i].count)
+      ++n;
+  }
+  addDWord(out, n);
+  for(unsigned i=0; i<COMMANDS; ++i) {
+    const TCommandStats &s = command[i];
+    if (!s.count)
+      continue;
+    addDWord(out, i);
+    addQWord(out, s.count);
+    addQWord(out, s.bytes_in);
+    addQWord(out, s.bytes_out);
+    encode(out, s.latency);
+  }
+  encode(out, fanout);
+  addDWord(out, sql.size());
+  for(TSQLSites::const_iterator p = sql.begin();
+      p != sql.end();
+      ++p)
+  {
+    addString(out, p->first);
+    encode(out, p->second.time);
+    encode(out, p->second.rows);
+    addQWord(out, p->second.slow);
+  }
+}
+
+inline void
+TServerStats::print(ostream &out, const char *name, const THistogram &h)
+{
+  char line[160];
+  snprintf(line, sizeof(line), "%-20s %9llu %9llu %9llu %9llu %9llu\n",
+           name, h.count(), h.percentile(50.0), h.percentile(99.0),
+           h.percentile(99.9), h.max());
+  out << line;
+}
+
+/**
+ * Print the figures in a human readable form.
+ */
+inline void
+TServerStats::print(ostream &out, unsigned clients) const
+{
+  char line[160];
+  out << "stats: uptime " << time(NULL) - started << "s, "
+      << clients << " clients" << endl;
+  snprintf(line, sizeof(line), "%-20s %9s %9s %9s %9s %9s %9s %9s\n",
+           "command", "count", "in", "out", "p50 us", "p99 us", "p999 us",
+           "max us");
+  out << line;
+  for(unsigned i=0; i<COMMANDS; ++i) {
+    const TCommandStats &s = command[i];
+    if (!s.count)
+      continue;
+    snprintf(line, sizeof(line),
+             "%-20s %9llu %9llu %9llu %9llu %9llu %9llu %9llu\n",
+             i ? commandName(i) : "OTHER", s.count, s.bytes_in, s.bytes_out,
+             s.latency.percentile(50.0), s.latency.percentile(99.0),
+             s.latency.percentile(99.9), s.latency.max());
+    out << line;
+  }
+  snprintf(line, sizeof(line), "%-20s %9s %9s %9s %9s %9s\n",
+           "", "count", "p50", "p99", "p999", "max");
+  out << line;
+  print(out, "fan-out (clients)", fanout);
+  print(out, "event loop (us)", loop);
+  for(TSQLSites::const_iterator p = sql.begin();
+      p != sql.end();
+      ++p)
+  {
+    print(out, ("sql " + p->first + " (us)").c_str(), p->second.time);
+    print(out, ("sql " + p->first + " (rows)").c_str(), p->second.rows);
+  }
+  out.flush();
+}
+
+} // namespace netedit
+
+#endif
@@ -0,0 +1,221 @@
+/*
+ * NetEdit -- A network management tool
+ * Copyright (C) 2003-2006 by Mark-André Hopf <mhopf@mark13.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __NETEDITD_TIMERWHEEL_HH
+#define __NETEDITD_TIMERWHEEL_HH
+
+#include <time.h>
+#include <sys/time.h>
+
+namespace netedit {
+
+class TTimerWheel;
+
+/**
+ * A timer managed by TTimerWheel. Derived classes implement expired().
+ */
+class TTimer
+{
+    friend class TTimerWheel;
+    TTimer *prev, *next;     // linkage within the wheel's slot
+    TTimerWheel *wheel;
+    unsigned long expires;   // tick at which the timer expires
+
+  public:
+    TTimer() {
+      prev = next = 0;
+      wheel = 0;
+    }
+    virtual ~TTimer() {
+      cancel();
+    }
+    bool isActive() const {
+      return next!=0;
+    }
+    inline void cancel();
+    virtual void expired() = 0;
+};
+
+/**
+ * A hierarchical timer wheel.
+ *
+ * Four levels of 64 slots cover 2^24 ticks. Adding and cancelling a
+ * timer costs O(1) and each tick only looks at a single slot, timers
+ * further in the future are moved down one level each time the level
+ * below has completed a revolution.
+ */
+class TTimerWheel
+{
+    friend class TTimer;
+
+    static const unsigned BITS   = 6;
+    static const unsigned SLOTS  = 1 << BITS;
+    static const unsigned MASK   = SLOTS - 1;
+    static const unsigned LEVELS = 4;
+
+    // list heads, only 'prev' and 'next' are used
+    struct THead: public TTimer {
+      THead() { prev = next = this; }
+      ~THead() { prev = next = 0; }
+      void expired() {}
+    };
+    THead slot[LEVELS][SLOTS];
+
+    unsigned long now;       // the next tick to be processed
+    unsigned count;          // number of active timers
+    unsigned tick;           // milliseconds per tick
+    timespec start;
+
+    unsigned long elapsed() const {
+      timespec t;
+      clock_gettime(CLOCK_MONOTONIC, &t);
+      return ((t.tv_sec - start.tv_sec) * 1000 +
+              (t.tv_nsec - start.tv_nsec) / 1000000) / tick;
+    }
+
+    void link(TTimer *t) {
+      long delta = t->expires - now;
+      unsigned level;
+      if (delta<0) {
+        t->expires = now;
+        delta = 0;
+      }
+      if (delta >= 1L << (BITS*LEVELS)) {
+        delta = (1L << (BITS*LEVELS)) - 1;
+        t->expires = now + delta;
+      }
+      for(level=0; level<LEVELS-1; ++level) {
+        if (delta < 1L << (BITS*(level+1)))
+          break;
+      }
+      TTimer *head = &slot[level][(t->expires >> (BITS*level)) & MASK];
+      t->prev = head->prev;
+      t->next = head;
+      head->prev->next = t;
+      head->prev = t;
+    }
+
+    void unlink(TTimer *t) {
+      t->prev->next = t->next;
+      t->next->prev = t->prev;
+      t->prev = t->next = 0;
+    }
+
+    // move all timers from the slot one level down; return the slot index
+    unsigned cascade(unsigned level) {
+      unsigned index = (now >> (BITS*level)) & MASK;
+      TTimer *head = &slot[level][index];
+      while(head->next != head) {
+        TTimer *t = head->next;
+        unlink(t);
+        link(t);
+      }
+      return index;
+    }
+
+    void process() {
+      unsigned index = now & MASK;
+      if (index==0) {
+        for(unsigned level=1; level<LEVELS; ++level) {
+          if (cascade(level)!=0)
+            break;
+        }
+      }
+      ++now;
+      TTimer *head = &slot[0][index];
+      while(head->next != head) {
+        TTimer *t = head->next;
+        unlink(t);
+        t->wheel = 0;
+        --count;
+        t->expired();
+      }
+    }
+
+  public:
+    TTimerWheel(unsigned tick = 100) {
+      this->tick = tick;
+      now = 0;
+      count = 0;
+      clock_gettime(CLOCK_MONOTONIC, &start);
+    }
+
+    unsigned getTick() const {
+      return tick;
+    }
+
+    /**
+     * Start or restart timer 't' to expire in 'ms' milliseconds.
+     */
+    void add(TTimer *t, unsigned long ms) {
+      t->cancel();
+      unsigned long ticks = (ms + tick - 1) / tick;
+      t->expires = now + (ticks ? ticks : 1);
+      t->wheel = this;
+      ++count;
+      link(t);
+    }
+
+    /**
+     * Process all ticks which have passed since the last call.
+     */
+    void run() {
+      unsigned long target = elapsed();
+      if (count==0) {
+        if (now <= target)
+          now = target + 1;
+        return;
+      }
+      while(now <= target)
+        process();
+    }
+
+    /**
+     * Return the time until the next tick in 'tv' or NULL when there is
+     * no active timer, suitable as timeout for select().
+     */
+    timeval* timeout(timeval *tv) const {
+      if (count==0)
+        return 0;
+      timespec t;
+      clock_gettime(CLOCK_MONOTONIC, &t);
+      long ms = (t.tv_sec - start.tv_sec) * 1000 +
+                (t.tv_nsec - start.tv_nsec) / 1000000;
+      long left = (long)now * tick - ms;
+      if (left<0)
+        left = 0;
+      tv->tv_sec  = left / 1000;
+      tv->tv_usec = (left % 1000) * 1000;
+      return tv;
+    }
+};
+
+inline void
+TTimer::cancel()
+{
+  if (!wheel)
+    return;
+  wheel->unlink(this);
+  --wheel->count;
+  wheel = 0;
+}
+
+} // namespace netedit
+
+#endif
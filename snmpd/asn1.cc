@@ -2,8 +2,10 @@
 #include <cassert>
 #include <iostream>
 #include <vector>
+#include "../lib/log.hh"
 
 using namespace std;
+using namespace netedit;
 
 const char *
 TASN1::tagName(unsigned tclass, unsigned tag)
@@ -87,7 +89,7 @@ void
 TASN1Encoder::encodeInteger(int a)
 {
   if (a<0) {
-    cerr << __PRETTY_FUNCTION__ << ": negative numbers not implemented yet" << endl;
+    LOG_ERROR(__PRETTY_FUNCTION__ << ": negative numbers not implemented yet");
     exit(EXIT_FAILURE);
   }
   unsigned char c;
@@ -22,8 +22,10 @@
 #include "asn1.hh"
 #include "md5.h"
 #include "des.hh"
+#include "../lib/log.hh"
 
 using namespace std;
+using namespace netedit;
 
 unsigned char engineID[9] = {
    0x80, 0x00, 0x00, 0x02, // enterprise id with msb set to 1
@@ -41,6 +43,30 @@ hexdump(unsigned char *ptr, size_t n)
   printf("\n");
 }
 
+static string
+hexstring(const unsigned char *ptr, size_t n)
+{
+  string s;
+  char hex[4];
+  for(size_t i=0; i<n; ++i) {
+    snprintf(hex, sizeof(hex), "%02x ", ptr[i]);
+    s += hex;
+  }
+  return s;
+}
+
+/**
+ * Dump ASN.1 data to stdout below the log messages written so far.
+ */
+static void
+dump(TASN1Decoder &in)
+{
+  if (!TLog::enabled(LOG_LEVEL_DEBUG))
+    return;
+  TLog::instance().flush();
+  in.print();
+}
+
 void
 HMAC_MD5(char *key, size_t keylen, char *data, size_t datalen, unsigned char digest[16])
 {
@@ -124,7 +150,7 @@ handleIncoming(unsigned char *buffer, size_t n)
   if (in.decode() && in.tag==TASN1::SEQUENCE) {
     int version;
     if (in.down() && in.decodeInteger(&version)) {
-      cout << "\nSNMP Version " << version << endl;
+      LOG_DEBUG("SNMP version " << version);
       switch(version) {
         case 3: { // see RFC 2572
           int msgID;
@@ -141,7 +167,7 @@ handleIncoming(unsigned char *buffer, size_t n)
           
           // 0:any, 1:SNMPv1, 2:SNMPv2, 3:User-Based Security Model (USM) (see 2571)
           if (msgSecurityModel != 3) {
-            cout << "SNMPv3 security model " << msgSecurityModel << "isn't handled yet.\n";
+            LOG_WARN("SNMPv3 security model " << msgSecurityModel << " isn't handled yet");
             break;
           }
           
@@ -155,8 +181,8 @@ handleIncoming(unsigned char *buffer, size_t n)
           
           if (!(in.decode() && in.tag==TASN1::OCTETSTRING && in.down() ))
             break;
-          cout << "UsmSecurityParameters:" << endl;
-          in.print();
+          LOG_DEBUG("UsmSecurityParameters:");
+          dump(in);
 
           if (!(in.decode() && in.tag==TASN1::SEQUENCE    && in.down() &&
                 in.decodeOctetString(&msgAuthoritativeEngineID) &&
@@ -166,15 +192,13 @@ handleIncoming(unsigned char *buffer, size_t n)
                 in.decodeOctetString(&msgAuthenticationParameters) &&
                 in.decodeOctetString(&msgPrivacyParameters) )) break;
 
-          cout << "msgAuthoritativeEngineID: ";
-          hexdump(msgAuthoritativeEngineID.data, msgAuthoritativeEngineID.size);
-
-          cout << "msgUserName: '" << string((char*)msgUserName.data, msgUserName.size) << "'\n";
+          LOG_DEBUG("msgAuthoritativeEngineID: " << hexstring(msgAuthoritativeEngineID.data, msgAuthoritativeEngineID.size));
+          LOG_DEBUG("msgUserName: '" << string((char*)msgUserName.data, msgUserName.size) << "'");
 
           // RFC 2574: 6.3.2.  Processing an Incoming Message
           // 1) fail if msgAuthenticationParameters field is not 12 octets long
           if (msgAuthenticationParameters.size!=12) {
-            cout << "msgAuthenticationParameters isn't 12 octets\n";
+            LOG_WARN("msgAuthenticationParameters isn't 12 octets");
             break;
           }
           // 2) save MAC received in the msgAuthenticationParameters field 
@@ -192,7 +216,7 @@ handleIncoming(unsigned char *buffer, size_t n)
 
           HMAC_MD5(key, 16, buffer, n, mac);
           if (memcmp(MAC, mac, 12)!=0) {
-            cerr << "authentication failed\n" << endl;
+            LOG_WARN("authentication failed");
             break;
           }
 
@@ -203,18 +227,18 @@ handleIncoming(unsigned char *buffer, size_t n)
           // 8.3.2.  Processing an Incoming Message
           OctetString scopedPDU;
           if (!in.decodeOctetString(&scopedPDU)) {
-            cout << "failed to decode octet string" << endl;
+            LOG_WARN("failed to decode octet string");
             break;
           }
           
           password_to_key_md5("barrulez", 8, ei, 2, key);
           
           if (scopedPDU.size & 7) {
-            cout << "scopedPDU isn't a multiple of 8 in size" << endl;
+            LOG_WARN("scopedPDU isn't a multiple of 8 in size");
             break;
           }
           if (msgPrivacyParameters.size!=8) {
-            cout << "msgPrivacyParameters.size!=8" << endl;
+            LOG_WARN("msgPrivacyParameters.size!=8");
             break;
           }
           
@@ -234,11 +258,11 @@ handleIncoming(unsigned char *buffer, size_t n)
           des_key(&dc, deskey);
           cbc_des_dec(&dc, iv, scopedPDU.data, scopedPDU.size / 8);
           
-          cout << "decrypted message:" << endl;
-          TASN1Decoder(scopedPDU.data, scopedPDU.size).print();
-          cout << endl;
+          LOG_DEBUG("decrypted message:");
+          TASN1Decoder pdu(scopedPDU.data, scopedPDU.size);
+          dump(pdu);
           
-          cout << "ok\n";
+          LOG_DEBUG("ok");
         } break;
       }
     }
@@ -262,15 +286,15 @@ send(int sock, sockaddr_in *remote, socklen_t len)
   0x03, 0x0f, 0x01, 0x01, 0x04, 0x00, 0x41, 0x01, 0x11 };
 
   TASN1Decoder in(u, sizeof(u));
-  cout << "send..." << endl;
-  in.print();
+  LOG_DEBUG("send...");
+  dump(in);
   
   in.decode();
   in.down();
   in.decode(); in.decode(); in.decode(); 
   in.down();
-  cout << "......\n";
-  in.print();
+  LOG_DEBUG("......");
+  dump(in);
   
   sendto(
     sock,
@@ -310,7 +334,7 @@ send2()
   struct hostent *hostinfo;
   hostinfo = gethostbyname(hostname.c_str());
   if (hostinfo==0) {
-    cerr << "couldn't resolve hostname '" << hostname << "'\n";
+    LOG_ERROR("couldn't resolve hostname '" << hostname << "'");
     ::close(sock);
     sock = -1;
     return false;
@@ -397,9 +421,10 @@ iorig.print();
   socklen_t len = sizeof(remote);
   char buffer[0xFFFF];
   int n = recvfrom(sock, buffer, 0xFFFF, MSG_TRUNC, (sockaddr*)&remote, &len);
-  printf("got %i bytes from %s\n", n, inet_ntoa(remote.sin_addr) );
+  LOG_DEBUG("got " << n << " bytes from " << inet_ntoa(remote.sin_addr));
 
-  TASN1Decoder(buffer, n).print();
+  TASN1Decoder reply(buffer, n);
+  dump(reply);
   
   handleIncoming(buffer, n);
   
@@ -460,6 +485,9 @@ main()
   exit(1);
 */
 
+  // still a prototype, so show what's going on
+  TLog::setLevel(LOG_LEVEL_DEBUG);
+
   char buffer[0xFFFF];
   int sock = socket (AF_INET, SOCK_DGRAM, 0);
   if (sock<0) {
@@ -481,11 +509,11 @@ main()
   }
   
   while(1) {
-    printf("waiting for data\n");
+    LOG_TRACE("waiting for data");
     sockaddr_in remote;
     socklen_t len = sizeof(remote);
     ssize_t n = recvfrom(sock, buffer, 0xFFFF, MSG_TRUNC, (sockaddr*)&remote, &len);  
-    printf("got %i bytes from %s\n", n, inet_ntoa(remote.sin_addr) );
+    LOG_DEBUG("got " << n << " bytes from " << inet_ntoa(remote.sin_addr));
 
     handleIncoming(buffer, n);
 
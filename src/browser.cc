@@ -18,6 +18,7 @@
  */
 
 #include "browser.hh"
+#include "../lib/log.hh"
 
 #include <toad/dnd/color.hh>
 #include <toad/figure.hh>
@@ -274,7 +275,7 @@ TDropSiteObjectType::drop(TDnDObject &drop)
   TSymbol *nd = new TSymbol;
   nd->type = TDnDObjectType::unflatten(drop);
 
-  cout << "dropped '" << nd->type << "'" << endl;
+  LOG_DEBUG("dropped '" << nd->type << "'");
 
   nd->label = "unnamed";
   
@@ -316,7 +317,7 @@ TFDragTool::mouseEvent(TFigureEditor *fe, TMouseEvent &me)
         startDrag(new TDnDObjectType(lf->label), me.modifier);
         return;
       }
-      cout << figure->getClassName() << " is not a figure i like" << endl;
+      LOG_WARN(figure->getClassName() << " is not a figure i like");
     }
   }
 }
@@ -410,7 +411,7 @@ TBrowser::TBrowser(TWindow *parent, const string &title):
             case ATV_VALUE:
               if (in.attribute == "name") {
                 f->label = in.value;
-cout << "load icon '" << iconname << "'" << endl;
+                LOG_TRACE("load icon '" << iconname << "'");
               }
               ok = true;
               break;
@@ -450,7 +451,7 @@ in.stop();
                 ok = in.parse();
 //                cout << "parsed object" << endl;
                 if (!ok) {
-                  cout << "not okay: " << in.getErrorText() << endl;
+                  LOG_ERROR("not okay: " << in.getErrorText());
                 }
                 in.setInterpreter(0);
                 
@@ -466,12 +467,12 @@ in.stop();
           }
       }
       if (!ok) {
-        cout << "parse error in icon file" << endl;
+        LOG_ERROR("parse error in icon file");
         exit(1);
       }
     }
   } else {
-    cout << "failed to open vector icon files" << endl;
+    LOG_WARN("failed to open vector icon files");
   }
   
   if (f)
@@ -503,7 +504,7 @@ TBrowser::arrangeFigures()
       m.map(r.w, r.h, &r.w, &r.h);
     }
 
-cout << "got shape " << r << endl;
+    LOG_TRACE("got shape " << r.x << ", " << r.y << ", " << r.w << ", " << r.h);
 
     (*p)->editEvent(ee);
     if (p==getModel()->begin()) {
@@ -49,6 +49,8 @@ class TNetEditor:
     
   public:
     TNetEditor(TWindow *parent, const string &title);
+    ~TNetEditor();
+    static void invalidateAll();
     void setModel(TMapModel *model) {
       this->model = model;
       super::setModel(model);
@@ -60,6 +62,8 @@ class TNetEditor:
     static const unsigned OP_CONNECT = 255;
     void mouseEvent(TMouseEvent &me);
     void invalidateFigure(TFigure*);
+    void paint();
+    TFigure* findFigureAt(int x, int y);
 };
 
 class TEditorWindow:
@@ -1,5 +1,6 @@
 #include "symbol.hh"
 #include "mapmodel.hh"
+#include "../lib/log.hh"
 
 using namespace netedit;
 
@@ -16,7 +17,7 @@ TConnection::editEvent(TFigureEditEvent &ee)
                
   switch(ee.type) {
     case TFigureEditEvent::REMOVED:
-      cout << "connection was removed" << endl;
+      LOG_TRACE("connection " << conn_id << " was removed");
       if (!model->itsme)
         model->server->sndDeleteConnection(model->id, conn_id);
       break;
@@ -41,6 +42,29 @@ TConnection::paint(toad::TPenBase &pen, toad::TFigure::EPaintType type)
   pen.drawLine(nd0->x, nd0->y, nd1->x, nd1->y);
 }
 
+/**
+ * Paint unselected connections in one go.
+ *
+ * The pen is set up once for all of them, so Xlib sends the lines to
+ * the X server as a single PolySegment request instead of changing the
+ * GC before each line.
+ */
+void
+TConnection::paintLines(toad::TPenBase &pen, const vector<TConnection*> &lines)
+{
+  if (lines.empty())
+    return;
+  pen.setColor(0,0,0);
+  pen.setLineStyle(TPen::SOLID);
+  pen.setLineWidth(1);
+  for(vector<TConnection*>::const_iterator p = lines.begin();
+      p != lines.end();
+      ++p)
+  {
+    pen.drawLine((*p)->nd0->x, (*p)->nd0->y, (*p)->nd1->x, (*p)->nd1->y);
+  }
+}
+
 void
 TConnection::getShape(toad::TRectangle *r)
 {
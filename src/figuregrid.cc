@@ -0,0 +1,180 @@
+/*
+ * NetEdit -- A network management tool
+ * Copyright (C) 2003-2006 by Mark-André Hopf <mhopf@mark13.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "figuregrid.hh"
+
+using namespace netedit;
+
+// figures overlapping more cells than this go into 'large'
+static const long long MAX_CELLS = 16;
+
+static bool
+overlaps(const TRectangle &a, const TRectangle &b)
+{
+  return a.x < b.x+b.w && b.x < a.x+a.w &&
+         a.y < b.y+b.h && b.y < a.y+a.h;
+}
+
+/**
+ * Enter the figure with its current bounding box, removing it from
+ * where it was before.
+ */
+void
+TFigureGrid::update(TFigure *f)
+{
+  TRectangle r;
+  f->getShape(&r);
+  if (f->mat) {
+    // the box around the transformed corners
+    int x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+    for(int i=0; i<4; ++i) {
+      int x, y;
+      f->mat->map(r.x + (i&1 ? r.w : 0), r.y + (i&2 ? r.h : 0), &x, &y);
+      if (i==0 || x<x0) x0 = x;
+      if (i==0 || x>x1) x1 = x;
+      if (i==0 || y<y0) y0 = y;
+      if (i==0 || y>y1) y1 = y;
+    }
+    r.x = x0;
+    r.y = y0;
+    r.w = x1-x0+1;
+    r.h = y1-y0+1;
+  }
+  if (r.w<=0) r.w = 1;
+  if (r.h<=0) r.h = 1;
+
+  TBoxes::iterator p = boxes.find(f);
+  if (p!=boxes.end()) {
+    if (p->second.x==r.x && p->second.y==r.y &&
+        p->second.w==r.w && p->second.h==r.h)
+      return;
+    remove(f, p->second);
+    p->second = r;
+  } else {
+    boxes[f] = r;
+  }
+
+  int c0 = cell(r.x), c1 = cell((long long)r.x+r.w-1);
+  int r0 = cell(r.y), r1 = cell((long long)r.y+r.h-1);
+  if ((long long)(c1-c0+1) * (r1-r0+1) > MAX_CELLS) {
+    large.insert(f);
+    return;
+  }
+  for(int row=r0; row<=r1; ++row)
+    for(int col=c0; col<=c1; ++col)
+      cells[TCell(row, col)].push_back(f);
+}
+
+void
+TFigureGrid::erase(TFigure *f)
+{
+  TBoxes::iterator p = boxes.find(f);
+  if (p==boxes.end())
+    return;
+  remove(f, p->second);
+  boxes.erase(p);
+}
+
+/**
+ * Remove the figure from the cells of the box it was entered with.
+ */
+void
+TFigureGrid::remove(TFigure *f, const TRectangle &r)
+{
+  if (large.erase(f))
+    return;
+  int c0 = cell(r.x), c1 = cell((long long)r.x+r.w-1);
+  int r0 = cell(r.y), r1 = cell((long long)r.y+r.h-1);
+  for(int row=r0; row<=r1; ++row) {
+    for(int col=c0; col<=c1; ++col) {
+      TCells::iterator p = cells.find(TCell(row, col));
+      if (p==cells.end())
+        continue;
+      for(TCellContent::iterator q = p->second.begin();
+          q != p->second.end();
+          ++q)
+      {
+        if (*q==f) {
+          *q = p->second.back();
+          p->second.pop_back();
+          break;
+        }
+      }
+      if (p->second.empty())
+        cells.erase(p);
+    }
+  }
+}
+
+void
+TFigureGrid::clear()
+{
+  cells.clear();
+  boxes.clear();
+  large.clear();
+}
+
+/**
+ * Append all figures whose bounding box intersects 'r' to 'result',
+ * each one once and in no particular order.
+ */
+void
+TFigureGrid::find(const TRectangle &r, vector<TFigure*> *result) const
+{
+  if (r.w<=0 || r.h<=0)
+    return;
+
+  set<TFigure*> found;
+  int c0 = cell(r.x), c1 = cell((long long)r.x+r.w-1);
+  int r0 = cell(r.y), r1 = cell((long long)r.y+r.h-1);
+
+  // only visit the occupied cells within the region, see GGrid::find()
+  TCells::const_iterator p = cells.lower_bound(TCell(r0, c0));
+  while(p!=cells.end() && p->first.first <= r1) {
+    if (p->first.second < c0) {
+      p = cells.lower_bound(TCell(p->first.first, c0));
+      continue;
+    }
+    if (p->first.second > c1) {
+      if (p->first.first == r1)
+        break;
+      p = cells.lower_bound(TCell(p->first.first+1, c0));
+      continue;
+    }
+    for(TCellContent::const_iterator q = p->second.begin();
+        q != p->second.end();
+        ++q)
+    {
+      if (found.insert(*q).second &&
+          overlaps(boxes.find(*q)->second, r))
+      {
+        result->push_back(*q);
+      }
+    }
+    ++p;
+  }
+
+  for(set<TFigure*>::const_iterator q = large.begin();
+      q != large.end();
+      ++q)
+  {
+    if (overlaps(boxes.find(*q)->second, r))
+      result->push_back(*q);
+  }
+}
@@ -0,0 +1,73 @@
+/*
+ * NetEdit -- A network management tool
+ * Copyright (C) 2003-2006 by Mark-André Hopf <mhopf@mark13.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __NETEDIT_FIGUREGRID_HH
+#define __NETEDIT_FIGUREGRID_HH 1
+
+#include <toad/figure.hh>
+#include <map>
+#include <set>
+#include <vector>
+
+namespace netedit {
+
+using namespace std;
+using namespace toad;
+
+/**
+ * A uniform grid over the bounding boxes of figures, the client's
+ * counterpart of the server's GGrid.
+ *
+ * A figure is entered into every cell its box overlaps. The box is
+ * kept, so that the figure can be found and removed after it was
+ * moved. Figures spanning too many cells, like long connections
+ * across the whole map, are kept in a list of their own instead.
+ */
+class TFigureGrid
+{
+    typedef pair<int, int> TCell; // (row, column)
+    typedef vector<TFigure*> TCellContent;
+    typedef map<TCell, TCellContent> TCells;
+    TCells cells;
+
+    typedef map<TFigure*, TRectangle> TBoxes;
+    TBoxes boxes;
+    set<TFigure*> large;
+
+    int cellsize;
+
+    int cell(long long v) const {
+      return v>=0 ? v/cellsize : -((-(v+1))/cellsize)-1;
+    }
+    void remove(TFigure *f, const TRectangle &r);
+
+  public:
+    TFigureGrid(int cellsize = 256) {
+      this->cellsize = cellsize;
+    }
+
+    void update(TFigure *f);
+    void erase(TFigure *f);
+    void clear();
+    void find(const TRectangle &r, vector<TFigure*> *result) const;
+};
+
+} // namespace netedit
+
+#endif
@@ -0,0 +1,215 @@
+/*
+ * NetEdit -- A network management tool
+ * Copyright (C) 2003-2006 by Mark-André Hopf <mhopf@mark13.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "iconloader.hh"
+#include "symbol.hh"
+#include "../lib/log.hh"
+
+#include <toad/figureeditor.hh>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fstream>
+
+using namespace netedit;
+
+TIconLoader::TIconLoader(const string &filename)
+{
+  this->filename = filename;
+  failed = false;
+  if (pipe(wakeup)<0) {
+    perror("failed to create pipe for the icon loader");
+    exit(1);
+  }
+  fcntl(wakeup[0], F_SETFL, O_NONBLOCK);
+  setFD(wakeup[0]);
+  running = pthread_create(&thread, NULL, run, this)==0;
+  if (!running) {
+    LOG_WARN("failed to start the icon loader, loading icons in the UI thread");
+    load();
+    done();
+  }
+}
+
+TIconLoader::~TIconLoader()
+{
+  if (running)
+    pthread_join(thread, NULL);
+  close(wakeup[0]);
+  close(wakeup[1]);
+}
+
+void*
+TIconLoader::run(void *data)
+{
+  TIconLoader *loader = static_cast<TIconLoader*>(data);
+  loader->load();
+  char c = 0;
+  while(write(loader->wakeup[1], &c, 1)<0 && errno==EINTR)
+    ;
+  return 0;
+}
+
+/**
+ * Parse the vector icons into 'icons'.
+ *
+ * This runs in the loader's thread and must not do anything that
+ * talks to the X server, like measuring text.
+ */
+void
+TIconLoader::load()
+{
+  ifstream fin(filename.c_str());
+  
+  string iconname;
+  TFGroup *g = 0;
+  
+  if (fin) {
+    TInObjectStream in(&fin);
+    in.setInterpreter(0);
+    while(in.parse()) {
+      bool ok = false;
+      switch(in.getDepth()) {
+        case 0:
+          switch(in.what) {
+            case ATV_FINISHED:
+              ok = true;
+              break;
+          }
+          break;
+        case 1:
+          switch(in.what) {
+            case ATV_GROUP:
+              if (in.type=="fischland::TDocument")
+                ok=true;
+              break;
+            case ATV_VALUE:
+            case ATV_FINISHED:
+              ok = true;
+              break;
+          }
+          break;
+        case 2:
+          switch(in.what) {
+            case ATV_GROUP:
+              if (in.type=="fischland::TSlide") {
+                if (!g) {
+                  g = new TFGroup;
+                  g->mat = new TMatrix2D();
+                  g->mat->scale(1.0/96.0, 1.0/96.0);
+                  g->mat->translate(48.0, 48.0);
+                }
+                ok = true;
+            } break;
+            case ATV_VALUE:
+              if (in.attribute == "name")
+                iconname = in.value;
+              ok = true;
+              break;
+            case ATV_FINISHED: {
+              if (g) {
+                if (icons.find(iconname)==icons.end()) {
+                  icons[iconname] = g;
+                  g = 0;
+                } else {
+                  LOG_WARN("duplicate icon '" << iconname << "'");
+                  delete g;
+                  g = 0;
+                }
+              }
+              ok = true;
+            } break;
+          }
+          break;
+        case 3:
+          switch(in.what) {
+            case ATV_GROUP:
+              if (in.type=="fischland::TLayer")
+                ok = true;
+              break;
+            case ATV_VALUE:
+            case ATV_FINISHED:
+              ok = true;
+              break;
+          }
+          break;
+        case 4:
+          switch(in.what) {
+            case ATV_GROUP: {
+              TObjectStore &os(getDefaultStore());
+              TSerializable *s = os.clone(in.type);
+              if (s) {
+                in.setInterpreter(s);
+                in.stop();
+                ok = in.parse();
+                if (!ok)
+                  LOG_ERROR("icon file: " << in.getErrorText());
+                in.setInterpreter(0);
+                
+                TFigure *nf = dynamic_cast<TFigure*>(s);
+                if (!nf)
+                  delete s;
+                else
+                  g->gadgets.add(nf);
+              }
+            }
+            break;
+          }
+      }
+      if (!ok) {
+        failed = true;
+        break;
+      }
+    }
+  } else {
+    LOG_WARN("failed to open vector icon file " << filename);
+  }
+  delete g; // an icon which wasn't completed
+}
+
+/**
+ * The thread has finished.
+ */
+void
+TIconLoader::canRead()
+{
+  char buffer[64];
+  while(read(wakeup[0], buffer, sizeof(buffer))>0)
+    ;
+  if (!running)
+    return;
+  pthread_join(thread, NULL);
+  running = false;
+  done();
+}
+
+/**
+ * Hand the icons over to the symbols in the UI thread.
+ */
+void
+TIconLoader::done()
+{
+  if (failed) {
+    LOG_ERROR("parse error in icon file " << filename);
+    exit(1);
+  }
+  iconsLoaded(icons);
+}
@@ -0,0 +1,65 @@
+/*
+ * NetEdit -- A network management tool
+ * Copyright (C) 2003-2006 by Mark-André Hopf <mhopf@mark13.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef __NETEDIT_ICONLOADER_HH
+#define __NETEDIT_ICONLOADER_HH 1
+
+#include <toad/ioobserver.hh>
+#include <toad/figure.hh>
+#include <pthread.h>
+#include <map>
+#include <string>
+
+namespace netedit {
+
+using namespace std;
+using namespace toad;
+
+/**
+ * Parses the vector icons in a background thread at startup, so that
+ * the client doesn't wait for the icon file before it shows the first
+ * map. Symbols are painted with a placeholder until the thread is done
+ * and wakes up the UI thread through a pipe, which hands the icons to
+ * iconsLoaded().
+ */
+class TIconLoader:
+  public TIOObserver
+{
+  public:
+    TIconLoader(const string &filename);
+    ~TIconLoader();
+
+  protected:
+    void canRead();
+
+  private:
+    string filename;
+    pthread_t thread;
+    bool running;
+    bool failed;
+    int wakeup[2];                // pipe to wake up the UI thread
+    map<string, TFigure*> icons;  // belongs to the thread while it runs
+
+    static void* run(void*);
+    void load();
+    void done();
+};
+
+} // namespace
+
+#endif
@@ -0,0 +1,260 @@
+/*
+ * NetEdit -- A network management tool
+ * Copyright (C) 2003-2006 by Mark-André Hopf <mhopf@mark13.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "mapdecoder.hh"
+#include "mapmodel.hh"
+#include "symbol.hh"
+#include "../lib/common.hh"
+#include "../lib/binary.hh"
+#include "../lib/log.hh"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace netedit;
+
+TMapDecoder::TMapDecoder(TServer *server)
+{
+  this->server = server;
+  mapid = 0;
+  current = 0;
+  quit = false;
+  pthread_mutex_init(&mutex, NULL);
+  pthread_cond_init(&cond, NULL);
+  if (pipe(wakeup)<0) {
+    perror("failed to create pipe for the map decoder");
+    exit(1);
+  }
+  fcntl(wakeup[0], F_SETFL, O_NONBLOCK);
+  setFD(wakeup[0]);
+  running = pthread_create(&thread, NULL, run, this)==0;
+  if (!running)
+    LOG_WARN("failed to start the map decoder, decoding maps in the UI thread");
+}
+
+TMapDecoder::~TMapDecoder()
+{
+  if (running) {
+    pthread_mutex_lock(&mutex);
+    quit = true;
+    pthread_cond_signal(&cond);
+    pthread_mutex_unlock(&mutex);
+    pthread_join(thread, NULL);
+  }
+  close(wakeup[0]);
+  close(wakeup[1]);
+  pthread_cond_destroy(&cond);
+  pthread_mutex_destroy(&mutex);
+}
+
+/**
+ * Start decoding a map into 'model'.
+ */
+void
+TMapDecoder::begin(TMapModel *model)
+{
+  mapid = model->id;
+  TItem item;
+  item.model = model;
+  pthread_mutex_lock(&mutex);
+  input.push_back(item);
+  pthread_mutex_unlock(&mutex);
+}
+
+/**
+ * Pass a message for the current map to the thread.
+ */
+void
+TMapDecoder::push(const string &msg)
+{
+  unsigned p = 4;
+  if (getDWord(msg, &p)==CMD_MAP_END)
+    mapid = 0;
+
+  TItem item;
+  item.model = 0;
+  item.msg = msg;
+  pthread_mutex_lock(&mutex);
+  input.push_back(item);
+  pthread_cond_signal(&cond);
+  pthread_mutex_unlock(&mutex);
+
+  // without a thread this is done in the UI thread right away
+  if (!running)
+    work(false);
+}
+
+void*
+TMapDecoder::run(void *data)
+{
+  static_cast<TMapDecoder*>(data)->work(true);
+  return 0;
+}
+
+/**
+ * Decode the queued messages. With 'wait' set, wait for more until
+ * the decoder is destroyed.
+ */
+void
+TMapDecoder::work(bool wait)
+{
+  while(true) {
+    pthread_mutex_lock(&mutex);
+    while(wait && input.empty() && !quit)
+      pthread_cond_wait(&cond, &mutex);
+    if (input.empty() || quit) {
+      pthread_mutex_unlock(&mutex);
+      break;
+    }
+    TItem item = input.front();
+    input.pop_front();
+    pthread_mutex_unlock(&mutex);
+
+    if (item.model) {
+      current = item.model;
+      continue;
+    }
+    if (!current || !decode(current, item.msg))
+      continue;
+
+    pthread_mutex_lock(&mutex);
+    output.push_back(current);
+    pthread_mutex_unlock(&mutex);
+    current = 0;
+    char c = 0;
+    while(write(wakeup[1], &c, 1)<0 && errno==EINTR)
+      ;
+  }
+}
+
+/**
+ * Apply a message to the model. Also used by the UI thread for the
+ * changes which arrive after the map was complete.
+ *
+ * \return true when the map is complete
+ */
+bool
+TMapDecoder::decode(TMapModel *model, const string &msg)
+{
+  unsigned p = 4;
+  unsigned cmd = getDWord(msg, &p);
+  getSDWord(msg, &p); // map id
+  switch(cmd) {
+    case CMD_MAP_SYMBOLS: {
+      unsigned n = getDWord(msg, &p);
+      vector<TSymbol*> symbols;
+      symbols.reserve(n);
+      for(unsigned i=0; i<n; ++i) {
+        TSymbol *nd = new TSymbol;
+        nd->id        = getSDWord(msg, &p);
+        nd->objid     = getSDWord(msg, &p);
+        nd->x         = getSDWord(msg, &p);
+        nd->y         = getSDWord(msg, &p);
+        nd->sysName   = getString(msg, &p);
+        nd->type      = getString(msg, &p);
+        symbols.push_back(nd);
+      }
+      model->insertSymbols(symbols);
+    } break;
+
+    case CMD_MAP_CONNECTIONS: {
+      unsigned n = getDWord(msg, &p);
+      for(unsigned i=0; i<n; ++i) {
+        int conn_id = getSDWord(msg, &p);
+        int id0     = getSDWord(msg, &p);
+        int id1     = getSDWord(msg, &p);
+        model->connectDevice(conn_id, model->deviceByID(id0), model->deviceByID(id1));
+      }
+    } break;
+
+    case CMD_MAP_END:
+      return true;
+
+    // changes made by other clients while the map was transferred
+    case CMD_ADD_SYMBOL: {
+      int symbol = getSDWord(msg, &p);
+      int x      = getSDWord(msg, &p);
+      int y      = getSDWord(msg, &p);
+      model->addSymbol(symbol, x, y);
+    } break;
+
+    case CMD_RENAME_SYMBOL: {
+      int oldid = getSDWord(msg, &p);
+      int newid = getSDWord(msg, &p);
+      model->renameSymbol(oldid, newid);
+    } break;
+
+    case CMD_DELETE_SYMBOL:
+      model->deleteSymbol(getSDWord(msg, &p));
+      break;
+
+    case CMD_TRANSLATE_SYMBOL: {
+      int symbol = getSDWord(msg, &p);
+      int x      = getSDWord(msg, &p);
+      int y      = getSDWord(msg, &p);
+      model->translateSymbol(symbol, x, y);
+    } break;
+
+    case CMD_ADD_CONNECTION: {
+      int conn   = getSDWord(msg, &p);
+      int sym0   = getSDWord(msg, &p);
+      int sym1   = getSDWord(msg, &p);
+      model->addConnection(conn, sym0, sym1);
+    } break;
+
+    case CMD_RENAME_CONNECTION: {
+      int oldid = getSDWord(msg, &p);
+      int newid = getSDWord(msg, &p);
+      model->renameConnection(oldid, newid);
+    } break;
+
+    case CMD_DELETE_CONNECTION:
+      model->deleteConnection(getSDWord(msg, &p));
+      break;
+
+    default:
+      LOG_WARN("map decoder received unexpected command " << cmd);
+  }
+  return false;
+}
+
+/**
+ * Hand the completed maps to the server in the UI thread.
+ */
+void
+TMapDecoder::canRead()
+{
+  char buffer[64];
+  while(read(wakeup[0], buffer, sizeof(buffer))>0)
+    ;
+  while(true) {
+    pthread_mutex_lock(&mutex);
+    if (output.empty()) {
+      pthread_mutex_unlock(&mutex);
+      break;
+    }
+    TMapModel *model = output.front();
+    output.pop_front();
+    pthread_mutex_unlock(&mutex);
+    server->decoded(model);
+  }
+}
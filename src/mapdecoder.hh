@@ -0,0 +1,90 @@
+/*
+ * NetEdit -- A network management tool
+ * Copyright (C) 2003-2006 by Mark-André Hopf <mhopf@mark13.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef __NETEDIT_MAPDECODER_HH
+#define __NETEDIT_MAPDECODER_HH 1
+
+#include <toad/ioobserver.hh>
+#include <pthread.h>
+#include <deque>
+#include <string>
+
+namespace netedit {
+
+class TServer;
+class TMapModel;
+
+using namespace std;
+using namespace toad;
+
+/**
+ * Builds the models of maps received from the server in a background
+ * thread, so that the UI stays responsive while large maps arrive.
+ *
+ * begin() hands a new, empty model to the thread. The following pages
+ * of the map and all changes to it are passed on with push() until
+ * CMD_MAP_END. The thread then queues the model and wakes up the UI
+ * thread through a pipe, which hands it to TServer::decoded().
+ *
+ * The model belongs to the thread until then and must not be touched
+ * by the UI thread.
+ */
+class TMapDecoder:
+  public TIOObserver
+{
+  public:
+    TMapDecoder(TServer *server);
+    ~TMapDecoder();
+
+    void begin(TMapModel *model);
+    void push(const string &msg);
+
+    // the map whose messages go to the decoder or 0
+    int map() const { return mapid; }
+
+    static bool decode(TMapModel *model, const string &msg);
+
+  protected:
+    void canRead();
+
+  private:
+    TServer *server;
+    int mapid;
+
+    struct TItem {
+      TMapModel *model;  // the next map or NULL
+      string msg;        // a message for the current map
+    };
+
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    bool running;
+    bool quit;
+    deque<TItem> input;        // for the thread
+    deque<TMapModel*> output;  // completed maps for the UI thread
+    int wakeup[2];             // pipe to wake up the UI thread
+    TMapModel *current;        // the map being decoded by the thread
+
+    static void* run(void*);
+    void work(bool wait);
+};
+
+} // namespace
+
+#endif
@@ -18,6 +18,7 @@
  */
 
 #include "mapmodel.hh"
+#include "../lib/log.hh"
 
 using namespace netedit;
 
@@ -26,6 +27,9 @@ TMapModel::TMapModel(TServer *server, int id) {
   this->server = server;
   this->id = id;
   itsme = false;
+  nextsymbol = nextconn = -1;
+  gridvalid = false;
+  CONNECT(sigChanged, this, changed);
 }
 
 TMapModel::~TMapModel() {
@@ -36,97 +40,184 @@ TMapModel::~TMapModel() {
 
 /**
  * Return an unique temporary ID within the net model for device d.
+ *
+ * Temporary ids are counted down from below the lowest id in the model
+ * and aren't reused.
  * \param d
  *   ignore this symbol during search
  */
 int
-TMapModel::uniqueDeviceID(TSymbol *d) const
+TMapModel::uniqueDeviceID(TSymbol *d)
 {
-  int id = -1;
-  bool collision;
-  do {
-    collision = false;
-    for(const_iterator p=begin();
-        p != end();
-        ++p)
-    {
-      TSymbol *s = dynamic_cast<TSymbol*>(*p);
-      if (!s || s==d)
-        continue;
-      if (id==s->id) {
-        --id;
-        collision = true;
-      }
-    }
-  } while(collision);
-  return id;
+  while(true) {
+    int id = nextsymbol--;
+    TSymbolIndex::const_iterator p = symbolindex.find(id);
+    if (p==symbolindex.end() || p->second==d)
+      return id;
+  }
 }
 
 
 TSymbol*
 TMapModel::deviceByID(int id) const
 {
+  TSymbolIndex::const_iterator p = symbolindex.find(id);
+  return p!=symbolindex.end() ? p->second : NULL;
+}
+
+TConnection*
+TMapModel::connByID(int id) const
+{
+  TConnectionIndex::const_iterator p = connindex.find(id);
+  return p!=connindex.end() ? p->second : NULL;
+}
+
+/**
+ * Add a symbol to the index after it was inserted into the model or
+ * got a new id.
+ */
+void
+TMapModel::indexSymbol(TSymbol *symbol)
+{
+  symbolindex[symbol->id] = symbol;
+  if (symbol->id <= nextsymbol)
+    nextsymbol = symbol->id - 1;
+  place(symbol);
+}
+
+void
+TMapModel::indexConnection(TConnection *c)
+{
+  connindex[c->conn_id] = c;
+  if (c->conn_id <= nextconn)
+    nextconn = c->conn_id - 1;
+  place(c);
+}
+
+void
+TMapModel::unindexSymbol(TSymbol *symbol)
+{
+  TSymbolIndex::iterator p = symbolindex.find(symbol->id);
+  if (p!=symbolindex.end() && p->second==symbol)
+    symbolindex.erase(p);
+  if (gridvalid)
+    grid.erase(symbol);
+}
+
+/**
+ * Rebuild the index from the figures in the model.
+ *
+ * The grid is rebuilt on its next use, as the connections might not be
+ * linked to their symbols yet.
+ */
+void
+TMapModel::reindex()
+{
+  gridvalid = false;
+  grid.clear();
+  nextsymbol = nextconn = -1;
+  symbolindex.clear();
   for(const_iterator p=begin();
       p != end();
       ++p)
   {
     TSymbol *nd = dynamic_cast<TSymbol*>(*p);
-    if ( nd && nd->id == id )
-      return nd;
+    if (nd)
+      indexSymbol(nd);
   }
-  return NULL;
-}
-
-TConnection*
-TMapModel::connByID(int id) const
-{
+  connindex.clear();
   for(TConnections::const_iterator p=connections.begin();
       p != connections.end();
       ++p)
   {
-    if ((*p)->conn_id == id )
-      return *p;
+    indexConnection(*p);
   }
-  return NULL;
 }
 
 /**
- * Return an unique temporary ID within the net model for device d.
+ * Return an unique temporary ID for a new connection, see
+ * uniqueDeviceID().
  */
 int
-TMapModel::uniqueConnID() const
+TMapModel::uniqueConnID()
 {
-  int id = -1;
-  bool collision;
-  do {
-    collision = false;
-    for(TConnections::const_iterator p=connections.begin();
-        p != connections.end();
-        ++p)
-    {
-      if (id==(*p)->conn_id) {
-        --id;
-        collision = true;
-      }
-    }
-  } while(collision);
-  return id;
+  while(true) {
+    int id = nextconn--;
+    if (connindex.find(id)==connindex.end())
+      return id;
+  }
 }
 
 void
 TMapModel::connectDevice(int conn_id, TSymbol *nd0, TSymbol *nd1)
 {
   if (!nd0 || !nd1) {
-    cout << "TMapModel::connectDevice: NULL argument" << endl;
+    LOG_ERROR("TMapModel::connectDevice: NULL argument");
     return;
   }
   if (nd0==nd1)
     return;
   TConnection *c = new TConnection(conn_id, nd0, nd1);
-  connections.push_back(c);
+  connections.insert(c);
+  indexConnection(c);
+  link(c);
   insert(begin(), c);
 }
 
+/**
+ * Add the connection to the lists of its symbols.
+ */
+void
+TMapModel::link(TConnection *c)
+{
+  if (c->nd0)
+    c->nd0->connections.push_back(c);
+  if (c->nd1 && c->nd1!=c->nd0)
+    c->nd1->connections.push_back(c);
+}
+
+void
+TMapModel::unlink(TConnection *c)
+{
+  TSymbol *nd[2] = { c->nd0, c->nd1 };
+  for(unsigned i=0; i<2; ++i) {
+    if (!nd[i])
+      continue;
+    TSymbol::TConnections &list = nd[i]->connections;
+    for(TSymbol::TConnections::iterator p = list.begin();
+        p != list.end();
+        ++p)
+    {
+      if (*p == c) {
+        *p = list.back();
+        list.pop_back();
+        break;
+      }
+    }
+  }
+}
+
+/**
+ * Add a page of symbols received from the server.
+ */
+void
+TMapModel::insertSymbols(const vector<TSymbol*> &symbols)
+{
+  if (symbols.empty())
+    return;
+  figures.clear();
+  for(vector<TSymbol*>::const_iterator p = symbols.begin();
+      p != symbols.end();
+      ++p)
+  {
+    storage.push_back(*p);
+    figures.insert(*p);
+    indexSymbol(*p);
+  }
+  type = ADD;
+  sigChanged();
+}
+
 void
 TMapModel::addSymbol(int id, int x, int y)
 {
@@ -135,6 +226,7 @@ TMapModel::addSymbol(int id, int x, int y)
   f->x  = x;
   f->y  = y;
   storage.push_back(f);
+  indexSymbol(f);
   
   type = ADD;
   figures.clear();
@@ -147,11 +239,13 @@ TMapModel::renameSymbol(int old_id, int new_id)
 {
   TSymbol *d = deviceByID(old_id);
   if (!d) {
-    cout << "TMapModel::renameSymbol: unknown symbol " << old_id << endl;
+    LOG_WARN("TMapModel::renameSymbol: unknown symbol " << old_id);
     return;
   }
 //cout << "renamed symbol " << old_id << " into " << new_id << endl;
+  unindexSymbol(d);
   d->id = new_id;
+  indexSymbol(d);
 }
 
 void
@@ -159,30 +253,16 @@ TMapModel::deleteSymbol(int id)
 {
   TSymbol *d = deviceByID(id);
   if (!d) {
-    cout << "TMapModel::deleteSymbol: unknown symbol " << id << endl;
+    LOG_WARN("TMapModel::deleteSymbol: unknown symbol " << id);
     return;
   }
 
-  for(iterator p=storage.begin();
-      p != storage.end();
-      ++p)
-  {
-    TSymbol *nd = dynamic_cast<TSymbol*>(*p);
-    if ( nd && nd->id == id ) {
-      type = REMOVE;
-      figures.clear();
-      figures.insert(nd);
-      sigChanged();
-
-#warning "not removing connections"
-
-      delete *p;
-
-      storage.erase(p);
-
-      break;
-    }
-  }
+  // erase() also removes the symbol's connections
+  itsme = true;
+  TFigureSet set;
+  set.insert(d);
+  erase(set);
+  itsme = false;
 }
 
 /**
@@ -194,7 +274,7 @@ TMapModel::translateSymbol(int id, int dx, int dy)
 {
   TSymbol *d = deviceByID(id);
   if (!d) {
-    cout << "TMapModel::translateSymbol: unknown symbol " << id << endl;
+    LOG_WARN("TMapModel::translateSymbol: unknown symbol " << id);
     return;
   }
 
@@ -207,6 +287,7 @@ TMapModel::translateSymbol(int id, int dx, int dy)
   
   d->x += dx;
   d->y += dy;
+  moved(d);
   
   type = MODIFIED;
   sigChanged();
@@ -228,10 +309,14 @@ TMapModel::renameConnection(int old_id, int new_id)
 //cout << "rename connection " << old_id << " to " << new_id << endl;
   TConnection *d = connByID(old_id);
   if (!d) {
-    cout << "TMapModel::renameConnection: unknown connection " << old_id << endl;
+    LOG_WARN("TMapModel::renameConnection: unknown connection " << old_id);
     return;
   }
+  TConnectionIndex::iterator p = connindex.find(old_id);
+  if (p!=connindex.end() && p->second==d)
+    connindex.erase(p);
   d->conn_id = new_id;
+  indexConnection(d);
 }
 
 void
@@ -239,16 +324,16 @@ TMapModel::deleteConnection(int id)
 {
   TConnection *c = connByID(id);
   if (!c) {
-    cout << "TMapModel::deleteConnection: unknown connection " << id << endl;
+    LOG_WARN("TMapModel::deleteConnection: unknown connection " << id);
     return;
   }
-cout << "TMapModel::deleteConnection going to erase connection" << endl;
+  LOG_TRACE("TMapModel::deleteConnection going to erase connection");
   itsme = true;
   TFigureSet set;
   set.insert(c);
   erase(set);
   itsme = false;
-cout << "TMapModel::deleteConnection erased connection" << endl;
+  LOG_TRACE("TMapModel::deleteConnection erased connection");
 }
 
 
@@ -260,41 +345,111 @@ TMapModel::erase(TFigureSet &set)
 
   // in case one of the connections points to one of the figures
   // in set, add 'em to the set to avoid dangling pointers
-  for(TConnections::iterator q = connections.begin();
-      q != connections.end();
-      ++q)
+  vector<TConnection*> attached;
+  for(TFigureSet::iterator p=set.begin();
+      p!=set.end();
+      ++p)
   {
-    if ( set.find((*q)->nd0) != set.end() ||
-         set.find((*q)->nd1) != set.end() )
-    {
-//      cout << "  erase connection" << endl;
-      set.insert(*q);
-      --q;
-    }
+    TSymbol *nd = dynamic_cast<TSymbol*>(*p);
+    if (nd)
+      attached.insert(attached.end(),
+                      nd->connections.begin(), nd->connections.end());
   }
+  set.insert(attached.begin(), attached.end());
 
-  // also remove TConnections from 'connections'
+  // also remove symbols from the index, TConnections from
+  // 'connections' and all of them from the grid
   for(TFigureSet::iterator p=set.begin();
       p!=set.end();
       ++p)
   {
+    if (gridvalid)
+      grid.erase(*p);
+    TSymbol *nd = dynamic_cast<TSymbol*>(*p);
+    if (nd)
+      unindexSymbol(nd);
     TConnection *c = dynamic_cast<TConnection*>(*p);
-    if (c) {
-      for(TConnections::iterator q = connections.begin();
-          q != connections.end();
-          ++q)
-      {
-        if ( *q == c) {
-          connections.erase(q);
-          break;
-        }
-      }
+    if (c && connections.erase(c)) {
+      TConnectionIndex::iterator q = connindex.find(c->conn_id);
+      if (q!=connindex.end() && q->second==c)
+        connindex.erase(q);
+      unlink(c);
     }
   }
   
   super::erase(set);
 }
 
+/**
+ * Update the grid after the symbol was moved.
+ */
+void
+TMapModel::moved(TSymbol *symbol)
+{
+  if (!gridvalid)
+    return;
+  place(symbol);
+  for(TSymbol::TConnections::const_iterator p = symbol->connections.begin();
+      p != symbol->connections.end();
+      ++p)
+  {
+    place(*p);
+  }
+}
+
+/**
+ * Keep the grid up to date with figures added or modified by the
+ * editor, like text, which aren't symbols or connections.
+ */
+void
+TMapModel::changed()
+{
+  if (!gridvalid || (type!=ADD && type!=MODIFIED))
+    return;
+  for(TFigureSet::const_iterator p = figures.begin();
+      p != figures.end();
+      ++p)
+  {
+    TSymbol *nd = dynamic_cast<TSymbol*>(*p);
+    if (nd)
+      moved(nd);
+    else
+      place(*p);
+  }
+}
+
+void
+TMapModel::place(TFigure *f)
+{
+  if (!gridvalid)
+    return;
+  TConnection *c = dynamic_cast<TConnection*>(f);
+  if (c && (!c->nd0 || !c->nd1))
+    return;
+  grid.update(f);
+}
+
+/**
+ * Append the symbols and connections whose bounding box intersects
+ * 'r' to 'result', in no particular order.
+ *
+ * Must be called from the UI thread.
+ */
+void
+TMapModel::findFigures(const TRectangle &r, vector<TFigure*> *result)
+{
+  if (!gridvalid) {
+    gridvalid = true;
+    for(const_iterator p=begin();
+        p != end();
+        ++p)
+    {
+      place(*p);
+    }
+  }
+  grid.find(r, result);
+}
+
 bool
 TMapModel::restore(TInObjectStream &in)
 {
@@ -307,22 +462,20 @@ TMapModel::restore(TInObjectStream &in)
       ++p)
   {
     TConnection *c = dynamic_cast<TConnection*>(*p);
-    if (c) {
-      connections.push_back(c);
-      for(TStorage::const_iterator p = storage.begin();
-          p != storage.end();
-          ++p)
-      {
-        TSymbol *nd = dynamic_cast<TSymbol*>(*p);
-        if (nd) {
-          if (nd->id == c->id0)
-            c->nd0 = nd;
-          if (nd->id == c->id1)
-            c->nd1 = nd;
-        }
-      }
-      
-    }
+    if (c)
+      connections.insert(c);
+  }
+  reindex();
+  for(TConnections::iterator p = connections.begin();
+      p != connections.end();
+      ++p)
+  {
+    TSymbol *nd;
+    if ((nd = deviceByID((*p)->id0)))
+      (*p)->nd0 = nd;
+    if ((nd = deviceByID((*p)->id1)))
+      (*p)->nd1 = nd;
+    link(*p);
   }
   return true;
 }
@@ -340,5 +493,7 @@ TMapModel::store(TOutObjectStream &out) const
       nd->id = ++i;
     }
   }
+  // the ids have changed
+  const_cast<TMapModel*>(this)->reindex();
   super::store(out);
 }
@@ -21,6 +21,9 @@
 
 #include <toad/figuremodel.hh>
 #include "server.hh"
+#include "figuregrid.hh"
+#include <map>
+#include <set>
 
 namespace netedit {
 
@@ -39,16 +42,20 @@ class TMapModel:
     ~TMapModel();
 
     // connections must be also figures so we can select and delete them?
-    typedef vector<TConnection*> TConnections;
+    typedef set<TConnection*> TConnections;
     TConnections connections;
 
-    int uniqueDeviceID(TSymbol *device) const;
+    int uniqueDeviceID(TSymbol *device);
     TSymbol* deviceByID(int id) const;
     
-    int uniqueConnID() const;
+    int uniqueConnID();
     TConnection* connByID(int id) const;
+
+    void indexSymbol(TSymbol *symbol);
+    void reindex();
     
     void connectDevice(int conn_id, TSymbol *nd0, TSymbol *nd1);
+    void insertSymbols(const vector<TSymbol*> &symbols);
 
     void addSymbol(int id, int  x, int y);    
     void renameSymbol(int old_id, int new_id);
@@ -59,8 +66,33 @@ class TMapModel:
     void renameConnection(int old_id, int new_id);
     void deleteConnection(int id);
 
+    void moved(TSymbol *symbol);
+    void findFigures(const TRectangle &r, vector<TFigure*> *result);
+
     void erase(TFigureSet&);
     SERIALIZABLE_INTERFACE(netedit::, TMapModel);    
+
+  private:
+    // symbols and connections by their ids
+    typedef map<int, TSymbol*> TSymbolIndex;
+    TSymbolIndex symbolindex;
+    typedef map<int, TConnection*> TConnectionIndex;
+    TConnectionIndex connindex;
+
+    // next temporary ids, below the lowest id in the model
+    int nextsymbol, nextconn;
+
+    // bounding boxes of the symbols and connections, built on first
+    // use because measuring the labels must be done in the UI thread
+    TFigureGrid grid;
+    bool gridvalid;
+    void place(TFigure *f);
+    void changed();
+
+    void unindexSymbol(TSymbol *symbol);
+    void indexConnection(TConnection *c);
+    void link(TConnection *c);
+    void unlink(TConnection *c);
 };
 typedef GSmartPointer<TMapModel> PNetModel;
 
@@ -27,6 +27,8 @@
 #include "snmp.hh"
 
 #include "snmpdialog.hh"
+#include "iconloader.hh"
+#include "../lib/log.hh"
 
 #include <toad/toad.hh>
 #include <toad/figureeditor.hh>
@@ -42,6 +44,8 @@
 #include <toad/filedialog.hh>
 
 #include <vector>
+#include <set>
+#include <algorithm>
 
 using namespace netedit;
 
@@ -149,7 +153,7 @@ void
 TEditorWindow::gotoMapByRow(unsigned i)
 {
   nextmap = server->getMapIDByRow(i);
-cout << "retrieve map " << nextmap << endl;
+  LOG_DEBUG("retrieve map " << nextmap);
   server->sndGetMapModelByRow(i);
 }
 
@@ -157,7 +161,7 @@ void
 TEditorWindow::gotoMapByID(unsigned id)
 {
   nextmap = id;
-cout << "retrieve map " << nextmap << endl;
+  LOG_DEBUG("retrieve map " << nextmap);
   server->sndGetMapModel(id);
 }
 
@@ -170,22 +174,42 @@ TEditorWindow::serverChanged()
       break;
     case TServer::NETMODEL_CHANGED:
       if (server->netmodel->id == nextmap) {
-        cout << "new netmodel " << nextmap << endl;
+        LOG_DEBUG("new netmodel " << nextmap);
         ne->setModel(server->netmodel);
       }
       break;
     default:
-      cout << "unknown server notification reason" << endl;
+      LOG_WARN("unknown server notification reason");
   }
 }
 
 
 
+// all editors, to repaint them once the icons are loaded
+static set<TNetEditor*> editors;
+
 TNetEditor::TNetEditor(TWindow *parent, const string &title):
   TFigureEditor(parent, title)
 {
   setModel(0);
   new TDropSiteObjectType(this);
+  editors.insert(this);
+}
+
+TNetEditor::~TNetEditor()
+{
+  editors.erase(this);
+}
+
+void
+TNetEditor::invalidateAll()
+{
+  for(set<TNetEditor*>::iterator p = editors.begin();
+      p != editors.end();
+      ++p)
+  {
+    (*p)->invalidateWindow();
+  }
 }
 
 void
@@ -193,6 +217,9 @@ TNetEditor::mouseEvent(TMouseEvent &me)
 {
   if (getOperation()!=OP_CONNECT) {
     super::mouseEvent(me);
+    // the final position of a dragged selection is sent right away
+    if (me.type==TMouseEvent::LUP && model && model->server)
+      model->server->sndMoves();
     return;
   }
   
@@ -220,12 +247,12 @@ TNetEditor::mouseEvent(TMouseEvent &me)
     
   switch(state) {
     case 0:
-      cout << "found first device" << endl;
+      LOG_TRACE("found first device");
       nd0 = nd;
       state = 1;
       break;
     case 1:
-      cout << "found second device" << endl;
+      LOG_TRACE("found second device");
       state = 0;
       // see also: TSymbol::editEvent
       int id = model->uniqueConnID();
@@ -244,29 +271,168 @@ TNetEditor::invalidateFigure(TFigure *f)
     return;
 
   TSymbol *nd = dynamic_cast<TSymbol*>(f);
-  if (f) {
-    for(TMapModel::TConnections::iterator p = model->connections.begin();
-        p != model->connections.end();
+  if (nd) {
+    for(TSymbol::TConnections::iterator p = nd->connections.begin();
+        p != nd->connections.end();
         ++p)
     {
-      if ((*p)->nd0 == nd || (*p)->nd1 == nd) {
-        TRectangle r((*p)->nd0->x, (*p)->nd0->y,
-                     (*p)->nd1->x - (*p)->nd0->x, (*p)->nd1->y - (*p)->nd0->y);
-        r.x+=window->getOriginX() + visible.x;
-        r.y+=window->getOriginY() + visible.y;
-        
-        r.x -= 2;
-        r.y -= 2;
-        r.w += 5;
-        r.h += 5;
-        
-        invalidateWindow(r);
-      }
+      TRectangle r((*p)->nd0->x, (*p)->nd0->y,
+                   (*p)->nd1->x - (*p)->nd0->x, (*p)->nd1->y - (*p)->nd0->y);
+      r.x+=window->getOriginX() + visible.x;
+      r.y+=window->getOriginY() + visible.y;
+      
+      r.x -= 2;
+      r.y -= 2;
+      r.w += 5;
+      r.h += 5;
+      
+      invalidateWindow(r);
     }
   }
   super::invalidateFigure(f);
 }
 
+// distance within which a click hits a connection
+static const double HIT_RANGE = 3.0;
+
+/**
+ * The order in which figures are painted: connections below symbols
+ * and symbols further down the map above those further up. This way
+ * the stacking doesn't depend on which part of the window is redrawn.
+ */
+static bool
+paintedBefore(TFigure *a, TFigure *b)
+{
+  TSymbol *sa = dynamic_cast<TSymbol*>(a);
+  TSymbol *sb = dynamic_cast<TSymbol*>(b);
+  if (!sa)
+    return sb || a<b;
+  if (!sb)
+    return false;
+  if (sa->y != sb->y)
+    return sa->y < sb->y;
+  if (sa->x != sb->x)
+    return sa->x < sb->x;
+  return sa < sb;
+}
+
+/**
+ * Paint the figures within the damaged region only, which are looked
+ * up in the model's grid instead of going through the whole map.
+ */
+void
+TNetEditor::paint()
+{
+  if (!window || !model) {
+    super::paint();
+    return;
+  }
+
+  TPen pen(window);
+  TRectangle damage;
+  pen.getClipBox(&damage);
+
+  // the damaged region on the sheet
+  TPoint p1, p2;
+  for(int i=0; i<4; ++i) {
+    int x, y;
+    mouse2sheet(damage.x + (i&1 ? damage.w : 0),
+                damage.y + (i&2 ? damage.h : 0),
+                &x, &y);
+    if (i==0) {
+      p1.x = p2.x = x;
+      p1.y = p2.y = y;
+    } else {
+      if (p1.x>x) p1.x=x;
+      if (p2.x<x) p2.x=x;
+      if (p1.y>y) p1.y=y;
+      if (p2.y<y) p2.y=y;
+    }
+  }
+  TRectangle region(p1.x-1, p1.y-1, p2.x-p1.x+2, p2.y-p1.y+2);
+
+  vector<TFigure*> figures;
+  model->findFigures(region, &figures);
+  sort(figures.begin(), figures.end(), paintedBefore);
+
+  pen.translate(window->getOriginX() + visible.x,
+                window->getOriginY() + visible.y);
+  if (mat)
+    pen.multiply(mat);
+  paintGrid(pen);
+
+  // connections come first and all but the selected ones share the
+  // same style, so they are drawn in a batch
+  vector<TConnection*> lines;
+  vector<TFigure*> rest;
+  for(vector<TFigure*>::const_iterator p = figures.begin();
+      p != figures.end();
+      ++p)
+  {
+    TConnection *c = dynamic_cast<TConnection*>(*p);
+    if (c && selection.find(c)==selection.end())
+      lines.push_back(c);
+    else
+      rest.push_back(*p);
+  }
+  TConnection::paintLines(pen, lines);
+
+  for(vector<TFigure*>::const_iterator p = rest.begin();
+      p != rest.end();
+      ++p)
+  {
+    bool selected = selection.find(*p)!=selection.end();
+    if ((*p)->mat) {
+      pen.push();
+      pen.multiply((*p)->mat);
+    }
+    (*p)->paint(pen, selected ? TFigure::SELECT : TFigure::NORMAL);
+    if (selected)
+      (*p)->paintSelection(pen, -1);
+    if ((*p)->mat)
+      pen.pop();
+  }
+}
+
+/**
+ * Find the topmost figure at x, y on the sheet, asking the model's grid
+ * for the figures nearby.
+ */
+TFigure*
+TNetEditor::findFigureAt(int x, int y)
+{
+  if (!model)
+    return super::findFigureAt(x, y);
+
+  int range = (int)HIT_RANGE;
+  vector<TFigure*> figures;
+  model->findFigures(TRectangle(x-range, y-range, 2*range+1, 2*range+1),
+                     &figures);
+  sort(figures.begin(), figures.end(), paintedBefore);
+
+  TFigure *found = 0;
+  double nearest = HIT_RANGE;
+  for(vector<TFigure*>::reverse_iterator p = figures.rbegin();
+      p != figures.rend();
+      ++p)
+  {
+    int fx = x, fy = y;
+    if ((*p)->mat) {
+      TMatrix2D m(*(*p)->mat);
+      m.invert();
+      m.map(x, y, &fx, &fy);
+    }
+    double d = (*p)->distance(fx, fy);
+    if (d<=0.0)
+      return *p;
+    if (d<=nearest) {
+      nearest = d;
+      found = *p;
+    }
+  }
+  return found;
+}
+
 TMainWindow::TMainWindow(TWindow *parent, const string &title):
   TForm(parent, title)
 {
@@ -411,6 +577,7 @@ main(int argc, char **argv, char **envv)
   string port     = "15001";
 
   string query;
+  unsigned moverate = 30;
   int i;
   for(i=1; i<argc; ++i) {
     if (strcmp(argv[i], "-h")==0 ||
@@ -440,6 +607,17 @@ main(int argc, char **argv, char **envv)
       if (i+1>=argc)
         break;
       query = argv[++i];
+    } else
+    if (strcmp(argv[i], "-r")==0 ||
+        strcmp(argv[i], "--move-rate")==0)
+    {
+      if (i+1>=argc)
+        break;
+      moverate = atoi(argv[++i]);
+      if (moverate>1000) {
+        fprintf(stderr, "error: --move-rate must be between 0 and 1000\n");
+        exit(EXIT_FAILURE);
+      }
     } else {
       fprintf(stderr, "error: unknown option '%s'\n", argv[i]);
       exit(EXIT_FAILURE);
@@ -472,7 +650,10 @@ main(int argc, char **argv, char **envv)
       TSNMPDialog *dlg = new TSNMPDialog(0, "NetEdit: " + query);
       dlg->hostname = query;
     } else {
+      // parsing the icons takes a while, the maps are shown meanwhile
+      new TIconLoader("netedit-icons.fish");
       server = new TServer(hostname, atoi(port.c_str()));
+      server->moverate = moverate;
       server->sndLogin(login, password);
 
       //    TBrowser wnd0(NULL, "NetEdit: Object Types");    
@@ -482,7 +663,7 @@ main(int argc, char **argv, char **envv)
     toad::mainLoop();
   }
   catch(exception e) {
-    cerr << "caught exception" << endl;
+    LOG_ERROR("caught exception");
   }
   toad::terminate();
   return 0;
@@ -19,6 +19,7 @@
 
 #include "netedit.hh"
 #include "nodeeditor.hh"
+#include "../lib/log.hh"
 
 #include <toad/textfield.hh>
 #include <toad/textarea.hh>
@@ -73,7 +74,7 @@ void
 TLockButton::mouseLDown(int, int, unsigned)
 {
   if (!isEnabled()) {
-    cout << "lock button isn't enabled" << endl;
+    LOG_DEBUG("lock button isn't enabled");
     return;
   }
 
@@ -23,6 +23,7 @@
 #include "nodeeditor.hh"
 #include "../lib/common.hh"
 #include "../lib/binary.hh"
+#include "../lib/log.hh"
 
 #include <errno.h>
 #include <sys/socket.h> 
@@ -102,9 +103,19 @@ TNodeModel::readwrite(bool rw)
   mgmtaddr.setEnabled(rw);
 }
 
-TServer::TServer(const string &hostname, unsigned port)
+static const unsigned HEARTBEAT_INTERVAL = 10; // seconds
+
+TServer::TServer(const string &hostname, unsigned port):
+  decoder(this)
 {
   sock = -1;
+  netmodel = 0;
+  wanted = 0;
+  flusher.server = this;
+  flusher.scheduled = false;
+  moverate = 30;
+  movetimer.server = this;
+  movetimer.scheduled = false;
 
   sockaddr_in name;
   in_addr ia;
@@ -114,7 +125,7 @@ TServer::TServer(const string &hostname, unsigned port)
     struct hostent *hostinfo;
     hostinfo = gethostbyname(hostname.c_str());
     if (hostinfo==0) {
-      cerr << "couldn't resolve hostname '" << hostname << "'" << endl;
+      LOG_ERROR("couldn't resolve hostname '" << hostname << "'");
       return;
     }
     name.sin_addr = *(struct in_addr *) hostinfo->h_addr;
@@ -134,13 +145,91 @@ TServer::TServer(const string &hostname, unsigned port)
   }
   
   if (connect(sock, (sockaddr*) &name, sizeof(sockaddr_in)) < 0) {
-    cerr << "couldn't connect to client" << endl;
+    LOG_ERROR("couldn't connect to server");
     return;
   }
 
   sndGetMapList();
   
   setFD(sock);
+
+  // keep our locks alive, the server drops them after --lock-ttl seconds
+  startTimer(HEARTBEAT_INTERVAL, 0, true);
+}
+
+void
+TServer::tick()
+{
+  sndHeartbeat();
+}
+
+/**
+ * Queue a message for the server after the pending moves, which must
+ * not be overtaken.
+ */
+void
+TServer::send(const string &msg)
+{
+  if (!moves.empty())
+    sndMoves();
+  queue(msg);
+}
+
+/**
+ * Queue a message for the server.
+ *
+ * Messages are collected and written together at the next iteration of
+ * the event loop, or right away once FLUSH_SIZE bytes are waiting. When
+ * a selection is dragged, the moves of all its symbols end up in the
+ * same write() and usually in the same TCP segment.
+ */
+void
+TServer::queue(const string &msg)
+{
+  outbuf += msg;
+  if (outbuf.size() >= FLUSH_SIZE) {
+    flush();
+  } else if (!flusher.scheduled) {
+    flusher.scheduled = true;
+    flusher.startTimer(0, 0, true);
+  }
+}
+
+/**
+ * Write the queued messages.
+ */
+void
+TServer::flush()
+{
+  size_t done = 0;
+  while(done < outbuf.size()) {
+    ssize_t n = write(sock, outbuf.c_str()+done, outbuf.size()-done);
+    if (n<0) {
+      if (errno==EINTR)
+        continue;
+      if (errno==EAGAIN)
+        break;
+      perror("error while writing to server");
+      done = outbuf.size();
+      break;
+    }
+    done += n;
+  }
+  outbuf.erase(0, done);
+
+  // try again with the next iteration when the socket is full
+  if (!outbuf.empty() && !flusher.scheduled) {
+    flusher.scheduled = true;
+    flusher.startTimer(0, 0, true);
+  }
+}
+
+void
+TServer::TFlushTimer::tick()
+{
+  stopTimer();
+  scheduled = false;
+  server->flush();
 }
 
 void
@@ -150,7 +239,7 @@ TServer::canRead()
     char cbuffer[4096];
     ssize_t n = read(sock, cbuffer, sizeof(cbuffer));
     if (n==0) {
-      cout << "lost connection to server" << endl;
+      LOG_INFO("lost connection to server");
       sleep(1);
       break;
     }
@@ -162,20 +251,88 @@ TServer::canRead()
       perror("error while reading from server");
       return;
     }
-cout << "got " << n << " bytes from server" << endl;
+    LOG_TRACE("got " << n << " bytes from server");
     buffer.append(cbuffer, n);
+    execute();
   }
-  
+}
+
+/**
+ * Returns true for the messages which refer to a map, the map id being
+ * their first argument.
+ */
+static bool
+forMap(unsigned cmd)
+{
+  switch(cmd) {
+    case CMD_MAP_SYMBOLS:
+    case CMD_MAP_CONNECTIONS:
+    case CMD_MAP_END:
+    case CMD_ADD_SYMBOL:
+    case CMD_RENAME_SYMBOL:
+    case CMD_DELETE_SYMBOL:
+    case CMD_TRANSLATE_SYMBOL:
+    case CMD_ADD_CONNECTION:
+    case CMD_RENAME_CONNECTION:
+    case CMD_DELETE_CONNECTION:
+      return true;
+  }
+  return false;
+}
+
+/**
+ * Handle all complete messages in the input buffer.
+ */
+void
+TServer::execute()
+{
   while(buffer.size()>=8) {
     unsigned p = 0;
     size_t n = getDWord(buffer, &p);
     if (buffer.size() < n)
       break;
     if (n==0) {
-      cout << "fatal error: received command of size 0" << endl;
+      LOG_ERROR("received command of size 0");
       exit(0);
     }
     unsigned cmd = getDWord(buffer, &p);
+    
+    // everything for the map being received goes to the decoder, so
+    // that it's applied in order, and once the map is complete it's
+    // kept until the decoder has handed the model over
+    if (!decoding.empty() && forMap(cmd) && n>=12) {
+      unsigned q = p;
+      int map = getSDWord(buffer, &q);
+      bool held = false;
+      if (map!=decoder.map()) {
+        for(deque<GSmartPointer<TMapModel> >::const_iterator m = decoding.begin();
+            m != decoding.end();
+            ++m)
+        {
+          if ((*m)->id==map) {
+            held = true;
+            break;
+          }
+        }
+      }
+      if (map==decoder.map() || held) {
+        if (held)
+          pending.push_back(buffer.substr(0, n));
+        else
+          decoder.push(buffer.substr(0, n));
+        if ((cmd==CMD_RENAME_SYMBOL || cmd==CMD_RENAME_CONNECTION) && n>=20) {
+          int oldid = getSDWord(buffer, &q);
+          int newid = getSDWord(buffer, &q);
+          if (cmd==CMD_RENAME_SYMBOL)
+            sndRenameSymbol(map, oldid, newid);
+          else
+            sndRenameConnection(map, oldid, newid);
+        }
+        buffer.erase(0, n);
+        continue;
+      }
+    }
+    
     switch(cmd) {
       case CMD_GET_MAPLIST: { // received map list
         map.clear();
@@ -192,35 +349,80 @@ cout << "got " << n << " bytes from server" << endl;
         sigChanged();
       } break;
       
-      case CMD_OPEN_MAP: { // received map
-        TMapModel *m = new TMapModel(0, getDWord(buffer, &p));
-        unsigned n;
-        n = getDWord(buffer, &p);
-//        cout << "got " << n << " symbols" << endl;
-        for(unsigned i=0; i<n; ++i) {
-          TSymbol *nd = new TSymbol;
-          nd->id = getSDWord(buffer, &p);
-          nd->objid     = getSDWord(buffer, &p);
-          nd->x         = getSDWord(buffer, &p);
-          nd->y         = getSDWord(buffer, &p);
-          nd->sysName   = getString(buffer, &p);
-          nd->type      = getString(buffer, &p);
-          m->push_back(nd);
-          // maplist.push_back(MapListEntry(id, name));
+      case CMD_OPEN_MAP: { // received map header, the pages will follow
+        int id = getSDWord(buffer, &p);
+        getDWord(buffer, &p); // symbols
+        getDWord(buffer, &p); // connections
+        // no pages follow when our copy from an earlier visit is current
+        bool uptodate = n>=24 && getDWord(buffer, &p);
+        
+        TMapModel *m = 0;
+        for(TMapCache::iterator c = cache.begin(); c!=cache.end(); ++c) {
+          if (c->model->id!=id)
+            continue;
+          if (uptodate && c->valid) {
+            LOG_DEBUG("reusing cached map " << id);
+            m = c->model;
+            loading = m;
+          }
+          cache.erase(c);
+          break;
         }
-        n = getDWord(buffer, &p);
-//        cout << "got " << n << " connections" << endl;
-        for(unsigned i=0; i<n; ++i) {
-          int conn_id = getSDWord(buffer, &p);
-          int id0     = getSDWord(buffer, &p);
-          int id1     = getSDWord(buffer, &p);
-//          cout << "  connect " << id0 << " <-> " << id1 << endl;
-          m->connectDevice(conn_id, m->deviceByID(id0), m->deviceByID(id1));
+        if (!m && uptodate && netmodel && netmodel->id==id) {
+          m = netmodel;
+          loading = m;
         }
-        m->server = this;
-        netmodel = m;
-        reason = NETMODEL_CHANGED;
-        sigChanged();
+        if (!m && !uptodate) {
+          // the pages are decoded in the background, the map is shown
+          // when it's complete
+          m = new TMapModel(0, id);
+          decoding.push_back(m);
+          decoder.begin(m);
+          break;
+        }
+        if (!m) {
+          LOG_ERROR("server didn't send map " << id << " which isn't cached");
+          m = new TMapModel(0, id);
+          loading = m;
+        }
+        
+        // the model isn't connected to the server until CMD_MAP_END, so
+        // it's displayed but not yet editable
+        if (id==wanted)
+          show(m);
+        m->server = 0;
+      } break;
+      
+      case CMD_CLOSE_MAP: { // received the version of a map we've closed
+        if (buffer.size()<20)
+          break;
+        int id = getSDWord(buffer, &p);
+        for(TMapCache::iterator c = cache.begin(); c!=cache.end(); ++c) {
+          if (c->model->id==id && !c->valid) {
+            c->valid   = true;
+            c->epoch   = getDWord(buffer, &p);
+            c->version = getDWord(buffer, &p);
+            break;
+          }
+        }
+      } break;
+
+      case CMD_MAP_SYMBOLS:
+      case CMD_MAP_CONNECTIONS:
+        // the pages of the map being received go to the decoder
+        LOG_WARN("received page of foreign map");
+        break;
+
+      case CMD_MAP_END: {
+        int map = getSDWord(buffer, &p);
+        if (!loading || map!=loading->id) {
+          LOG_WARN("received end of foreign map");
+          break;
+        }
+        loading->server = this;
+        if (loading!=netmodel)
+          retire(loading); // another map has been requested in the meantime
+        loading = 0;
       } break;
       
       case CMD_ADD_SYMBOL:
@@ -229,10 +431,11 @@ cout << "got " << n << " bytes from server" << endl;
           int symbol = getSDWord(buffer, &p);
           int x      = getSDWord(buffer, &p);
           int y      = getSDWord(buffer, &p);
-          if (map!=netmodel->id) {
-            cout << "received add symbol for foreign map" << endl;
+          TMapModel *m = model(map);
+          if (!m) {
+            LOG_WARN("received add symbol for foreign map");
           } else {
-            netmodel->addSymbol(symbol, x, y);
+            m->addSymbol(symbol, x, y);
           }
         }
         break;
@@ -242,10 +445,11 @@ cout << "got " << n << " bytes from server" << endl;
           int map   = getSDWord(buffer, &p);
           int oldid = getSDWord(buffer, &p);
           int newid = getSDWord(buffer, &p);
-          if (map!=netmodel->id) {
-            cout << "received rename symbol for foreign map" << endl;
+          TMapModel *m = model(map);
+          if (!m) {
+            LOG_WARN("received rename symbol for foreign map");
           } else {
-            netmodel->renameSymbol(oldid, newid);
+            m->renameSymbol(oldid, newid);
             sndRenameSymbol(map,oldid, newid);
           }
         }
@@ -255,10 +459,11 @@ cout << "got " << n << " bytes from server" << endl;
         if (buffer.size()>=16) {
           int map    = getSDWord(buffer, &p);
           int symbol = getSDWord(buffer, &p);
-          if (map!=netmodel->id) {
-            cout << "received delete symbol for foreign map" << endl;
+          TMapModel *m = model(map);
+          if (!m) {
+            LOG_WARN("received delete symbol for foreign map");
           } else {
-            netmodel->deleteSymbol(symbol);
+            m->deleteSymbol(symbol);
           }
         }
         break;
@@ -269,10 +474,11 @@ cout << "got " << n << " bytes from server" << endl;
           int symbol = getSDWord(buffer, &p);
           int x      = getSDWord(buffer, &p);
           int y      = getSDWord(buffer, &p);
-          if (map!=netmodel->id) {
-            cout << "received translate symbol for foreign map" << endl;
+          TMapModel *m = model(map);
+          if (!m) {
+            LOG_WARN("received translate symbol for foreign map");
           } else {
-            netmodel->translateSymbol(symbol, x, y);
+            m->translateSymbol(symbol, x, y);
           }
         }
       } break;
@@ -283,10 +489,11 @@ cout << "got " << n << " bytes from server" << endl;
           int conn   = getSDWord(buffer, &p);
           int sym0   = getSDWord(buffer, &p);
           int sym1   = getSDWord(buffer, &p);
-          if (map!=netmodel->id) {
-            cout << "received add connection for foreign map" << endl;
+          TMapModel *m = model(map);
+          if (!m) {
+            LOG_WARN("received add connection for foreign map");
           } else {
-            netmodel->addConnection(conn, sym0, sym1);
+            m->addConnection(conn, sym0, sym1);
           }
         }
         break;
@@ -296,10 +503,11 @@ cout << "got " << n << " bytes from server" << endl;
           int map   = getSDWord(buffer, &p);
           int oldid = getSDWord(buffer, &p);
           int newid = getSDWord(buffer, &p);
-          if (map!=netmodel->id) {
-            cout << "received rename symbol for foreign map" << endl;
+          TMapModel *m = model(map);
+          if (!m) {
+            LOG_WARN("received rename symbol for foreign map");
           } else {
-            netmodel->renameConnection(oldid, newid);
+            m->renameConnection(oldid, newid);
             sndRenameConnection(map,oldid, newid);
           }
         }
@@ -309,10 +517,11 @@ cout << "got " << n << " bytes from server" << endl;
         if (buffer.size()>=16) {
           int map  = getSDWord(buffer, &p);
           int conn = getSDWord(buffer, &p);
-          if (map!=netmodel->id) {
-            cout << "received delete connection for foreign map" << endl;
+          TMapModel *m = model(map);
+          if (!m) {
+            LOG_WARN("received delete connection for foreign map");
           } else {
-            netmodel->deleteConnection(conn);
+            m->deleteConnection(conn);
           }
         }
         break;
@@ -320,16 +529,16 @@ cout << "got " << n << " bytes from server" << endl;
       case CMD_OPEN_NODE: {
         int node   = getSDWord(buffer, &p);
         if (nodemap.find(node)!=nodemap.end()) {
-          cout << "error: node " << node << " is already open" << endl;
+          LOG_ERROR("node " << node << " is already open");
           break;
         }
         unsigned result = getDWord(buffer, &p);
         if (result==NODE_IS_NOT) {
-          cout << "error: can't open node " << node << endl;
+          LOG_ERROR("can't open node " << node);
           break;
         }
         if (result==NODE_LOCKED_LOCAL) {
-          cout << "error: node " << node << " is reported as locally locked" << endl;
+          LOG_ERROR("node " << node << " is reported as locally locked");
           break;
         }
         TNodeModel *nm = new TNodeModel;
@@ -353,22 +562,22 @@ cout << "got " << n << " bytes from server" << endl;
         int node_id   = getSDWord(buffer, &p);
         nodemap_t::iterator q = nodemap.find(node_id);
         if (q==nodemap.end()) {
-          cout << "error: update for non-local node" << endl;
+          LOG_ERROR("update for non-local node");
           break;
         }
         if (q->second->lock.get() == LOCKED_LOCAL) {
-          cout << "error: server tried to update locally owned node" << endl;
+          LOG_ERROR("server tried to update locally owned node");
           break;
         }
         q->second->fetch(buffer, &p);
       } break;
       
       case CMD_LOCK_NODE: {
-cout << "received lock node" << endl;
+        LOG_DEBUG("received lock node");
         int node_id   = getSDWord(buffer, &p);
         nodemap_t::iterator q = nodemap.find(node_id);
         if (q==nodemap.end()) {
-          cout << "error: lock for non-local node" << endl;
+          LOG_ERROR("lock for non-local node");
           break;
         }
         int state = getByte(buffer, &p);
@@ -380,19 +589,22 @@ cout << "received lock node" << endl;
       } break;
 
       case CMD_UNLOCK_NODE: {
-cout << "received unlock node" << endl;
+        LOG_DEBUG("received unlock node");
         int node_id   = getSDWord(buffer, &p);
         nodemap_t::iterator q = nodemap.find(node_id);
         if (q==nodemap.end()) {
-          cout << "error: unlock for non-local node" << endl;
+          LOG_ERROR("unlock for non-local node");
           break;
         }
         TNodeModel *nm = q->second;
         nm->lock.set(UNLOCKED);
       } break;
+
+      case CMD_HEARTBEAT:
+        break;
       
       default:
-        cout << "received unknown command " << cmd << endl;
+        LOG_WARN("received unknown command " << cmd);
 
     }
     buffer.erase(0, n);
@@ -410,7 +622,7 @@ TServer::sndLogin(const string &login, const string &passwd)
   addString(&msg, passwd);
 
   setDWord(&msg, 0, msg.size());
-  write(sock, msg.c_str(), msg.size());
+  send(msg);
 }
 
 void
@@ -419,14 +631,14 @@ TServer::sndGetMapList()
   string cmd;
   addDWord(&cmd, 8);
   addDWord(&cmd, CMD_GET_MAPLIST); // get map list
-  write(sock, cmd.c_str(), cmd.size());
+  send(cmd);
 }
 
 void
 TServer::sndGetMapModelByRow(unsigned maplistrow)
 {
   if (maplistrow >= maplist.size()) {
-    cout << "warning: TServer::getMapModelByRow: index out of range" << endl;
+    LOG_WARN("TServer::getMapModelByRow: index out of range");
     return;
   }
   sndGetMapModel(maplist[maplistrow].map_id);
@@ -436,7 +648,7 @@ unsigned
 TServer::getMapIDByRow(unsigned maplistrow)
 {
   if (maplistrow >= maplist.size()) {
-    cout << "warning: TServer::getMapIDByRow: index out of range" << endl;
+    LOG_WARN("TServer::getMapIDByRow: index out of range");
     return 0;
   }
   return maplist[maplistrow].map_id;
@@ -445,12 +657,109 @@ TServer::getMapIDByRow(unsigned maplistrow)
 void
 TServer::sndGetMapModel(unsigned map_id)
 {
-#warning "should cache map models"
+  wanted = map_id;
+  if (netmodel && netmodel->server && netmodel->id==(int)map_id) {
+    reason = NETMODEL_CHANGED;
+    sigChanged();
+    return;
+  }
+
   string cmd;
-  addDWord(&cmd, 12);
+  addDWord(&cmd, 0);
   addDWord(&cmd, CMD_OPEN_MAP);
   addSDWord(&cmd, map_id);
-  write(sock, cmd.c_str(), cmd.size());
+  // offer our copy from an earlier visit
+  for(TMapCache::iterator c = cache.begin(); c!=cache.end(); ++c) {
+    if (c->model->id==(int)map_id && c->valid) {
+      addDWord(&cmd, c->epoch);
+      addDWord(&cmd, c->version);
+      break;
+    }
+  }
+  setDWord(&cmd, 0, cmd.size());
+  send(cmd);
+}
+
+/**
+ * The model receiving changes for the given map: the current one or one
+ * which has been closed but whose version hasn't been confirmed yet.
+ */
+TMapModel*
+TServer::model(int map_id)
+{
+  if (netmodel && netmodel->id==map_id)
+    return netmodel;
+  for(TMapCache::iterator c = cache.begin(); c!=cache.end(); ++c) {
+    if (c->model->id==map_id && !c->valid)
+      return c->model;
+  }
+  return 0;
+}
+
+/**
+ * Called by the decoder when a map has been received completely.
+ */
+void
+TServer::decoded(TMapModel *model)
+{
+  // the decoder completes the maps in the order they were started
+  GSmartPointer<TMapModel> keep = model;
+  decoding.pop_front();
+
+  // changes which arrived after CMD_MAP_END
+  for(deque<string>::iterator p = pending.begin(); p != pending.end(); ) {
+    unsigned q = 8;
+    if (getSDWord(*p, &q)==model->id) {
+      TMapDecoder::decode(model, *p);
+      p = pending.erase(p);
+    } else {
+      ++p;
+    }
+  }
+
+  model->server = this;
+  if (model->id==wanted)
+    show(model);
+  else
+    retire(model); // another map has been requested in the meantime
+}
+
+/**
+ * Make the model the current map.
+ */
+void
+TServer::show(TMapModel *model)
+{
+  if (netmodel && netmodel!=model) {
+    if (netmodel->id!=model->id)
+      retire(netmodel);
+    else
+      netmodel->server = 0; // replaced, the map stays open
+  }
+  netmodel = model;
+  reason = NETMODEL_CHANGED;
+  sigChanged();
+}
+
+/**
+ * Close the map on the server and keep the model for a later visit.
+ */
+void
+TServer::retire(TMapModel *model)
+{
+  if (!model->server) // not completely received
+    return;
+  sndDropMapModel(model->id);
+  model->server = 0;
+
+  TCachedMap c;
+  c.model   = model;
+  c.valid   = false;
+  c.epoch   = 0;
+  c.version = 0;
+  cache.push_front(c);
+  if (cache.size() > MAP_CACHE_SIZE)
+    cache.pop_back();
 }
 
 void
@@ -460,7 +769,7 @@ TServer::sndDropMapModel(int mapid)
   addDWord(&cmd, 12);
   addDWord(&cmd, CMD_CLOSE_MAP);
   addSDWord(&cmd, mapid);
-  write(sock, cmd.c_str(), cmd.size());
+  send(cmd);
 }
 
 void
@@ -473,8 +782,8 @@ TServer::sndAddSymbol(int map, int sym, int x, int y)
   addSDWord(&cmd, sym);
   addSDWord(&cmd, x);
   addSDWord(&cmd, y);
-cout << "sndAddSymbol("<<map<<", "<<sym<<", "<<x<<", "<<y<<")\n";
-  write(sock, cmd.c_str(), cmd.size());
+  LOG_DEBUG("sndAddSymbol("<<map<<", "<<sym<<", "<<x<<", "<<y<<")");
+  send(cmd);
 }
 
 void
@@ -487,7 +796,7 @@ TServer::sndRenameSymbol(int map, int old_id, int new_id)
   addSDWord(&cmd, old_id);
   addSDWord(&cmd, new_id);
   //cout << "sndRenameSymbol("<<map<<", "<<old_id<<", "<<new_id<<")\n";
-  write(sock, cmd.c_str(), cmd.size());
+  send(cmd);
 }
 
 void
@@ -498,20 +807,64 @@ TServer::sndDeleteSymbol(int map, int sym)
   addDWord(&cmd, CMD_DELETE_SYMBOL);
   addSDWord(&cmd, map);
   addSDWord(&cmd, sym);
-  write(sock, cmd.c_str(), cmd.size());
+  send(cmd);
 }
 
+/**
+ * Move a symbol.
+ *
+ * The first move is sent right away, the following ones are added up
+ * per symbol and sent at most 'moverate' times per second, so the load
+ * doesn't depend on the rate of mouse events while dragging. Pending
+ * moves are sent before any other message and when the mouse button is
+ * released, see sndMoves().
+ */
 void
 TServer::sndTranslateSymbol(int map_id, int symbol_id, int x, int y)
 {
-  string cmd;
-  addDWord(&cmd, 24);
-  addDWord(&cmd, CMD_TRANSLATE_SYMBOL);
-  addSDWord(&cmd, map_id);
-  addSDWord(&cmd, symbol_id);
-  addSDWord(&cmd, x);
-  addSDWord(&cmd, y);
-  write(sock, cmd.c_str(), cmd.size());
+  TMove &move = moves[make_pair(map_id, symbol_id)];
+  move.dx += x;
+  move.dy += y;
+  if (!moverate) {
+    sndMoves();
+  } else if (!movetimer.scheduled) {
+    sndMoves();
+    movetimer.scheduled = true;
+    movetimer.startTimer(0, 1000000 / moverate, true);
+  }
+}
+
+/**
+ * Send the pending moves.
+ */
+void
+TServer::sndMoves()
+{
+  for(TMoves::iterator p = moves.begin(); p!=moves.end(); ++p) {
+    if (p->second.dx==0 && p->second.dy==0)
+      continue;
+    string cmd;
+    addDWord(&cmd, 24);
+    addDWord(&cmd, CMD_TRANSLATE_SYMBOL);
+    addSDWord(&cmd, p->first.first);
+    addSDWord(&cmd, p->first.second);
+    addSDWord(&cmd, p->second.dx);
+    addSDWord(&cmd, p->second.dy);
+    queue(cmd);
+  }
+  moves.clear();
+}
+
+void
+TServer::TMoveTimer::tick()
+{
+  // stop once the drag is over
+  if (server->moves.empty()) {
+    stopTimer();
+    scheduled = false;
+    return;
+  }
+  server->sndMoves();
 }
 
 void
@@ -526,7 +879,7 @@ TServer::sndConnectSymbol(int map_id, int conn_id, int symbol_id0, int symbol_id
   addSDWord(&msg, symbol_id1);
   
   setDWord(&msg, 0, msg.size());
-  write(sock, msg.c_str(), msg.size());
+  send(msg);
 }
 
 void
@@ -539,7 +892,7 @@ TServer::sndRenameConnection(int map, int old_id, int new_id)
   addSDWord(&cmd, old_id);
   addSDWord(&cmd, new_id);
   //cout << "sndRenameConnection("<<map<<", "<<old_id<<", "<<new_id<<")\n";
-  write(sock, cmd.c_str(), cmd.size());
+  send(cmd);
 }
 
 void
@@ -550,13 +903,13 @@ TServer::sndDeleteConnection(int map, int sym)
   addDWord(&cmd, CMD_DELETE_CONNECTION);
   addSDWord(&cmd, map);
   addSDWord(&cmd, sym);
-  write(sock, cmd.c_str(), cmd.size());
+  send(cmd);
 }
 
 void
 TServer::sndOpenNode(int node_id)
 {
-cout << "send open node" << endl;
+  LOG_DEBUG("send open node");
   nodemap_t::iterator p = nodemap.find(node_id);
   if (p!=nodemap.end()) {
     ++p->second->refcount;
@@ -569,7 +922,7 @@ cout << "send open node" << endl;
   addDWord(&cmd, 12);
   addDWord(&cmd, CMD_OPEN_NODE);
   addDWord(&cmd, node_id);
-  write(sock, cmd.c_str(), cmd.size());
+  send(cmd);
 }
 
 void
@@ -591,7 +944,7 @@ TServer::sndSetNode(TNodeEditor *ne)
   addDWord(&msg, nm->topoflags);
 
   setDWord(&msg, 0, msg.size());
-  write(sock, msg.c_str(), msg.size());
+  send(msg);
 }
 
 
@@ -600,7 +953,7 @@ TServer::sndCloseNode(int node_id)
 {
   nodemap_t::iterator p = nodemap.find(node_id);
   if (p==nodemap.end()) {
-    cout << "error: can't close unknown node" << endl;
+    LOG_ERROR("can't close unknown node");
     return;
   }
   --p->second->refcount;
@@ -613,7 +966,7 @@ TServer::sndCloseNode(int node_id)
   addDWord(&cmd, CMD_CLOSE_NODE);
   addDWord(&cmd, node_id);
   setDWord(&cmd, 0, cmd.size());
-  write(sock, cmd.c_str(), cmd.size());
+  send(cmd);
 }
 
 void
@@ -624,7 +977,7 @@ TServer::sndLockNode(int node_id)
   addDWord(&cmd, CMD_LOCK_NODE);
   addDWord(&cmd, node_id);
   setDWord(&cmd, 0, cmd.size());
-  write(sock, cmd.c_str(), cmd.size());
+  send(cmd);
 }
 
 void
@@ -635,5 +988,17 @@ TServer::sndUnlockNode(int node_id)
   addDWord(&cmd, CMD_UNLOCK_NODE);
   addDWord(&cmd, node_id);
   setDWord(&cmd, 0, cmd.size());
-  write(sock, cmd.c_str(), cmd.size());
+  send(cmd);
+}
+
+void
+TServer::sndHeartbeat()
+{
+  if (sock==-1)
+    return;
+  string cmd;
+  addDWord(&cmd, 0);
+  addDWord(&cmd, CMD_HEARTBEAT);
+  setDWord(&cmd, 0, cmd.size());
+  send(cmd);
 }
@@ -21,11 +21,16 @@
 
 #include <toad/model.hh>
 #include <toad/ioobserver.hh>
+#include <toad/simpletimer.hh>
 #include <toad/stl/vector.hh>
 #include <toad/table.hh>
 #include <string>
+#include <list>
+#include <deque>
+#include <map>
 
 #include "symbol.hh"
+#include "mapdecoder.hh"
 
 namespace netedit {
 
@@ -36,11 +41,53 @@ using namespace std;
 using namespace toad;
 
 class TServer:
-  public TModel, TIOObserver
+  public TModel, TIOObserver, TSimpleTimer
 {
     int sock;
     string buffer;
     
+    // messages not yet written to the server
+    string outbuf;
+    static const size_t FLUSH_SIZE = 16384;
+    class TFlushTimer:
+      public TSimpleTimer
+    {
+      public:
+        TServer *server;
+        bool scheduled;
+      protected:
+        void tick();
+    };
+    TFlushTimer flusher;
+    void send(const string &msg);
+    void queue(const string &msg);
+    void flush();
+    friend class TFlushTimer;
+    
+    // moves added up while a selection is dragged
+    struct TMove {
+      TMove() { dx = dy = 0; }
+      int dx, dy;
+    };
+    typedef std::map<pair<int, int>, TMove> TMoves; // (map, symbol) -> move
+    TMoves moves;
+    class TMoveTimer:
+      public TSimpleTimer
+    {
+      public:
+        TServer *server;
+        bool scheduled;
+      protected:
+        void tick();
+    };
+    TMoveTimer movetimer;
+    friend class TMoveTimer;
+    GSmartPointer<TMapModel> loading; // map being received from the server
+    TMapDecoder decoder;
+    deque<GSmartPointer<TMapModel> > decoding; // maps passed to the decoder
+    deque<string> pending; // changes to completed maps not yet decoded()
+    int wanted; // the map requested last
+    
     struct MapListEntry {
       MapListEntry(int map_id, const string &name) {
         this->map_id = map_id;
@@ -54,11 +101,34 @@ class TServer:
       string name;
     };
 
+    /**
+     * Maps visited before, most recently used first.
+     *
+     * When another map is opened the current one is closed on the server
+     * and kept here. The server replies with the version of the map the
+     * client holds and until then changes to it are still applied. When
+     * the map is visited again its version is sent along and the server
+     * only transfers the map when it has changed since.
+     */
+    struct TCachedMap {
+      GSmartPointer<TMapModel> model;
+      bool valid;              // the server has confirmed the version
+      unsigned epoch, version;
+    };
+    typedef list<TCachedMap> TMapCache;
+    TMapCache cache;
+    static const unsigned MAP_CACHE_SIZE = 8;
+
+    TMapModel* model(int map_id);
+    void show(TMapModel *model);
+    void retire(TMapModel *model);
+
   public:    
     typedef GVector<MapListEntry> MapList;
     MapList maplist;
     TSingleSelectionModel map;
-    TMapModel *netmodel;
+    GSmartPointer<TMapModel> netmodel;
+    unsigned moverate; // moves sent per second while dragging, 0 for all
 
     TServer(const string &hostname, unsigned port);
     
@@ -74,11 +144,13 @@ class TServer:
     void sndGetMapModelByRow(unsigned maplistrow);
     void sndGetMapModel(unsigned map_id);
     void sndDropMapModel(int map);
+    void decoded(TMapModel *model);
 
     void sndAddSymbol(int map, int sym, int x, int y);
     void sndRenameSymbol(int map, int old_id, int new_id);
     void sndDeleteSymbol(int map, int sym);
     void sndTranslateSymbol(int map, int sym, int x, int y);
+    void sndMoves();
 
     void sndConnectSymbol(int map, int conn, int sym0, int sym1);
     void sndRenameConnection(int map, int old_id, int new_id);
@@ -90,9 +162,12 @@ class TServer:
     
     void sndLockNode(int id);
     void sndUnlockNode(int id);
+    void sndHeartbeat();
 
   protected:
     void canRead();
+    void tick();
+    void execute();
 };
 
 typedef GSmartPointer<TServer> PServer;
@@ -20,6 +20,7 @@
 
 #include "servermodel.hh"
 #include "symbol.hh"
+#include "../lib/log.hh"
 
 #include <map>
 #include <cstdio>
@@ -55,10 +56,9 @@ TServerModel::open(const string &path)
   for (int i=0; i<NREG; ++i) {
     r = regcomp(&reg[i], regstr[i], REG_EXTENDED);
     if (r!=0) {
-      cerr << "regcomp failed for '" << regstr[i]<< "'" << endl;
       char buffer[1024];
-      r = regerror(r, &reg[i], buffer, sizeof(buffer));
-      cout << buffer << endl;
+      regerror(r, &reg[i], buffer, sizeof(buffer));
+      LOG_ERROR("regcomp failed for '" << regstr[i] << "': " << buffer);
       exit(1);
     }
   }
@@ -21,6 +21,7 @@
 
 #include "../snmpd/asn1.hh"
 #include "snmp.hh"
+#include "../lib/log.hh"
 #include <strstream>
 
 #include <sys/types.h>
@@ -91,7 +92,7 @@ TSNMPQuery::open()
   struct hostent *hostinfo;
   hostinfo = gethostbyname(hostname.c_str());
   if (hostinfo==0) {
-    cerr << "couldn't resolve hostname '" << hostname << "'\n";
+    LOG_ERROR("couldn't resolve hostname '" << hostname << "'");
     ::close(sock);
     sock = -1;
     return false;
@@ -272,7 +273,7 @@ TSNMPQuery::canRead()
             in.down())
         {
           if (cmd!=PDU_RESPONSE) {
-            cout << "expected Response-PDU" << endl;
+            LOG_WARN("expected Response-PDU");
             break;
           }
           if (in.decodeInteger(&requestID) &&
@@ -301,7 +302,7 @@ TSNMPQuery::canRead()
 //                    cout << s << ": " << errorStatus << "," << errorIndex << endl;
                     snmpQuery(s.c_str(), true);
                   } else {
-                    cout << "walk finished" << endl;
+                    LOG_DEBUG("walk finished");
                     result->insert(result->getValue().size(), "*** walk finished ***\n"/*, false*/);
                   }
                 }
@@ -407,7 +408,7 @@ cout << endl;
     if (i==sminode->oidlen) {
       size_t taillen = oidlen - i;
       if (taillen>=maxtail) {
-        cerr << "maxtail execed by tail of " << taillen << " bytes" << endl;
+        LOG_WARN("maxtail exceeded by tail of " << (unsigned long)taillen << " bytes");
         taillen = maxtail - 1;
       }
       if (!isnew) {
@@ -501,7 +502,7 @@ netedit::initialize()
       continue;
     string name = mibdir + de->d_name;
     if (!smiLoadModule(name.c_str())) {
-      cout << "warning: failed to load MIB file '" << name << "'\n";
+      LOG_WARN("failed to load MIB file '" << name << "'");
     }
   }
   
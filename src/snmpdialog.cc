@@ -19,6 +19,7 @@
 
 #include "netedit.hh"
 #include "snmpdialog.hh"
+#include "../lib/log.hh"
 
 #include <toad/textfield.hh>
 #include <toad/textarea.hh>
@@ -43,9 +44,9 @@ class TSNMPQueryModel:
     TOIDNode *node;
 
     void* _createNode() { return 0; }
-    void _deleteNode(void*) { cerr << "deleted node" << endl; }
+    void _deleteNode(void*) { LOG_WARN("deleted node"); }
     void* _getRoot() const { return root; }
-    void _setRoot(void*) { cerr << "can't set root" << endl; }
+    void _setRoot(void*) { LOG_WARN("can't set root"); }
     void* _getDown(void *ptr) const {
       TSNMPTree::node_t *node = static_cast<TSNMPTree::node_t*>(ptr);
 /*
@@ -55,9 +56,9 @@ class TSNMPQueryModel:
 */
       return node->down;
     }
-    void _setDown(void*, void*) { cerr << "can't set down" << endl; }
+    void _setDown(void*, void*) { LOG_WARN("can't set down"); }
     void* _getNext(void *p) const { return static_cast<node_t*>(p)->next; }
-    void _setNext(void*, void*)  { cerr << "can't set next" << endl; }
+    void _setNext(void*, void*)  { LOG_WARN("can't set next"); }
     TSNMPTree::node_t& operator[](size_t i) {
       if (i>=rows->size())
         return *static_cast<TSNMPTree::node_t*>(0);
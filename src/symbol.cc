@@ -23,15 +23,18 @@
 
 #include <toad/action.hh>
 #include <toad/popupmenu.hh>
+#include <toad/region.hh>
 
-#include <fstream>
 #include <map>
+#include <list>
+#include <math.h>
 
 #include "netedit.hh"
 #include "mapmodel.hh"
 #include "symbol.hh"
 #include "snmpdialog.hh"
 #include "server.hh"
+#include "../lib/log.hh"
 
 #include "browser.hh"
 
@@ -74,8 +77,14 @@ imgtxt_t netedit::imgtxt[] =
   { 0, 0 }
 };
 
+// the vector icons by type, see TIconLoader
 map<string, TFigure*> figtxt;
+static bool iconsloaded = false;
 
+/**
+ * Load the bitmap icons, which are only used by the old variant of the
+ * object type browser.
+ */
 void
 netedit::loadimages()
 {
@@ -90,7 +99,7 @@ netedit::loadimages()
     string file = "icons/";
     file += p->file;
     if (!p->bmp->load(file)) {
-      cout << "failed to load icon " << p->file << endl;
+      LOG_WARN("failed to load icon " << p->file);
       delete p->bmp;
       p->bmp = 0;
     } else {
@@ -98,147 +107,55 @@ netedit::loadimages()
     }
     ++p;
   };
+}
 
-  // new variant vector icons
-  ifstream fin("netedit-icons.fish");
-  
-  string iconname;
-  TFGroup *g = 0;
-  
-  if (fin) {
-    // TATVParser in(&fin);
-    TInObjectStream in(&fin);
-    in.setInterpreter(0);
-    while(in.parse()) {
-#if 0
-      switch(in.what) {
-        case ATV_START:
-          cout << "ATV_START";
-          break;
-        case ATV_VALUE:
-          cout << "ATV_VALUE";
-          break;
-        case ATV_GROUP:
-          cout << "ATV_GROUP";
-          break;
-        case ATV_FINISHED:
-          cout << "ATV_FINISHED";
-          break;
-      }
-      cout << ": ('" << in.attribute 
-           << "', '" << in.type
-           << "', '" << in.value
-           << "'), position=" << in.getPosition()
-           << ", depth=" << in.getDepth() << endl;
-#endif
-      bool ok = false;
-      switch(in.getDepth()) {
-        case 0:
-          switch(in.what) {
-            case ATV_FINISHED:
-              ok = true;
-              break;
-          }
-          break;
-        case 1:
-          switch(in.what) {
-            case ATV_GROUP:
-              if (in.type=="fischland::TDocument")
-                ok=true;
-              break;
-            case ATV_VALUE:
-            case ATV_FINISHED:
-              ok = true;
-              break;
-          }
-          break;
-        case 2:
-          switch(in.what) {
-            case ATV_GROUP:
-              if (in.type=="fischland::TSlide") {
-                if (!g) {
-                  g = new TFGroup;
-                  g->mat = new TMatrix2D();
-                  g->mat->scale(1.0/96.0, 1.0/96.0);
-                  g->mat->translate(48.0, 48.0);
-                }
-                ok = true;
-            } break;
-            case ATV_VALUE:
-              if (in.attribute == "name") {
-                iconname = in.value;
-cout << "load icon '" << iconname << "'" << endl;
-              }
-              ok = true;
-              break;
-            case ATV_FINISHED: {
-              if (g) {
-                if (figtxt.find(iconname)==figtxt.end()) {
-                  g->calcSize();
-                  figtxt[iconname] = g;
-                  g = 0;
-                } else {
-                  cout << "duplicate icon '" << iconname << "'\n";
-                }
-              }
-              ok = true;
-            } break;
-          }
-          break;
-        case 3:
-          switch(in.what) {
-            case ATV_GROUP:
-              if (in.type=="fischland::TLayer")
-                ok = true;
-              break;
-            case ATV_VALUE:
-            case ATV_FINISHED:
-              ok = true;
-              break;
-          }
-          break;
-        case 4:
-          switch(in.what) {
-            case ATV_GROUP: {
-              TObjectStore &os(getDefaultStore());
-              TSerializable *s = os.clone(in.type);
-              if (s) {
-//                cout << "parse object" << endl;
-                in.setInterpreter(s);
-in.stop();
-                ok = in.parse();
-//                cout << "parsed object" << endl;
-                if (!ok) {
-                  cout << "not okay: " << in.getErrorText() << endl;
-                }
-                in.setInterpreter(0);
-                
-                TFigure *nf = dynamic_cast<TFigure*>(s);
-                if (!nf)
-                  delete nf;
-                else {
-                  g->gadgets.add(nf);
-                }
-              }
-            }
-            break;
-          }
-      }
-      if (!ok) {
-        cout << "parse error in icon file" << endl;
-        exit(1);
-      }
-    }
-  } else {
-    cout << "failed to open vector icon files" << endl;
+/**
+ * Take over the vector icons parsed by the TIconLoader and repaint the
+ * symbols, which were painted with a placeholder so far.
+ */
+void
+netedit::iconsLoaded(map<string, TFigure*> &icons)
+{
+  for(map<string, TFigure*>::iterator p = icons.begin();
+      p != icons.end();
+      ++p)
+  {
+    TFGroup *g = dynamic_cast<TFGroup*>(p->second);
+    if (g)
+      g->calcSize();
   }
-
-
+  figtxt.swap(icons);
+  iconsloaded = true;
+  flushIconCache();
+  TNetEditor::invalidateAll();
 }
 
 TSymbol::TSymbol()
 {
   set(0,0,32,32);
+  labelw = -1;
+}
+
+static const char *LABEL_FONT = "arial,helvetica,sans-serif:size=8";
+static const char *SHAPE_FONT = "arial,helvetica,sans-serif:size=10";
+
+/**
+ * Measure the label unless it's unchanged since the last time.
+ */
+void
+TSymbol::measure()
+{
+  const string &txt = labelText();
+  if (labelw>=0 && txt==measured)
+    return;
+
+  static TFont *labelfont = TPen::lookupFont(LABEL_FONT);
+  static TFont *shapefont = TPen::lookupFont(SHAPE_FONT);
+  measured = txt;
+  labelw = labelfont->getTextWidth(txt);
+  labelh = labelfont->getHeight();
+  shapew = shapefont->getTextWidth(txt);
+  shapeh = shapefont->getHeight();
 }
  
 unsigned
@@ -253,6 +170,259 @@ TSymbol::mouseLDown(TFigureEditor *editor, int mx, int my, unsigned)
   return CONTINUE;
 }
 
+/**
+ * Symbols are painted in less detail the smaller they appear on screen:
+ * below LOD_LABEL_SIZE pixels without their label and below
+ * LOD_ICON_SIZE pixels as a square in the color of their category.
+ */
+static const double LOD_LABEL_SIZE = 20.0;
+static const double LOD_ICON_SIZE  = 8.0;
+
+/**
+ * The factor by which the pen scales lengths.
+ */
+static double
+scaleOf(TPenBase &pen)
+{
+  const TMatrix2D *m = pen.getMatrix();
+  if (!m)
+    return 1.0;
+  return sqrt(fabs(m->a11 * m->a22 - m->a12 * m->a21));
+}
+
+/**
+ * A rectangle in the color of the symbol's category, painted instead
+ * of the icon when the symbol is tiny or the icons aren't loaded yet.
+ * Types without an icon are orange.
+ */
+static void
+paintPlaceholder(TPenBase &pen, const string &type, int objid, bool known,
+                 int x, int y, int w, int h)
+{
+  if (!known)
+    pen.setFillColor(255,128,0);
+  else if (type.compare(0, 9, "Computer:", 9)==0)
+    pen.setFillColor(0,0,255);
+  else if (type.compare(0, 10, "Connector:", 10)==0)
+    pen.setFillColor(255,255,0);
+  else if (type.compare(0, 4, "Map:", 4)==0 && objid!=0)
+    pen.setFillColor(0,0,255);
+  else
+    pen.setFillColor(191,191,191);
+  pen.fillRectanglePC(x,y,w,h);
+}
+
+/**
+ * Paint the background of the symbol's category and the vector icon.
+ */
+static void
+paintIcon(TPenBase &pen, const string &type, int objid, TFigure *figure,
+          int cx, int cy, TFigure::EPaintType ptype)
+{
+  TRectangle br;
+  br.set(cx,cy,32,32);
+
+  pen.setColor(0,0,0);
+  pen.setLineWidth(1);
+  if (type.compare(0, 9, "Computer:", 9)==0) {
+    pen.setFillColor(0, 0, 255);
+    pen.fillRectangle(br);
+  } else
+  if (type.compare(0, 10, "Connector:", 10)==0) {
+    pen.setFillColor(255,255,0);
+    TPoint p[4];
+    p[0].set(br.x + br.w / 2, br.y);
+    p[1].set(br.x + br.w    , br.y + br.h / 2);
+    p[2].set(br.x + br.w / 2, br.y + br.h);
+    p[3].set(br.x           , br.y + br.h / 2);
+    pen.fillPolygon(p, 4);
+  } else
+  if (type.compare(0, 4, "Map:", 4)==0) {
+    if (objid==0) // id 0 isn't a valid map
+      pen.setFillColor(191,191,191);
+    else
+      pen.setFillColor(0,0,255);
+    pen.fillCircle(br);
+  }
+
+  pen.push();
+  pen.translate(cx, cy);
+  if (figure->mat)
+    pen.multiply(figure->mat);
+  figure->paint(pen, ptype);
+  pen.pop();
+
+  pen.setLineColor(0,0,0);
+  pen.setLineWidth(1);
+}
+
+/**
+ * Icons rendered into bitmaps, by zoom level, type and paint type.
+ *
+ * TOAD's bitmaps are opaque, so the icons of connectors and maps come
+ * with a mask of the pixels covered by their diamond or circle, through
+ * which they are copied and which leaves the map and the connections
+ * around them visible. Computers fill their whole cell and need none.
+ *
+ * The zoom levels used last are kept, so that views with different
+ * zoom levels don't flush each other's icons.
+ */
+struct TCachedIcon {
+  TBitmap *bitmap;
+  TRegion *mask;   // pixels to be copied, 0 for all
+};
+typedef map<string, TCachedIcon> TCachedIcons;
+struct TIconScale {
+  double scale;
+  TCachedIcons icons;
+};
+typedef list<TIconScale> TIconCache;
+static TIconCache iconcache; // most recently used zoom level first
+static const unsigned ICON_SCALES = 4;
+
+static void
+flushIcons(TCachedIcons &icons)
+{
+  for(TCachedIcons::iterator p = icons.begin();
+      p != icons.end();
+      ++p)
+  {
+    delete p->second.bitmap;
+    delete p->second.mask;
+  }
+  icons.clear();
+}
+
+void
+netedit::flushIconCache()
+{
+  for(TIconCache::iterator p = iconcache.begin();
+      p != iconcache.end();
+      ++p)
+  {
+    flushIcons(p->icons);
+  }
+  iconcache.clear();
+}
+
+/**
+ * The icons cached for the zoom level, making it the most recently used.
+ */
+static TCachedIcons&
+cachedIcons(double scale)
+{
+  TIconCache::iterator p = iconcache.begin();
+  while(p!=iconcache.end() && p->scale!=scale)
+    ++p;
+  if (p==iconcache.end()) {
+    iconcache.push_front(TIconScale());
+    iconcache.front().scale = scale;
+    if (iconcache.size() > ICON_SCALES) {
+      flushIcons(iconcache.back().icons);
+      iconcache.pop_back();
+    }
+  } else
+  if (p!=iconcache.begin()) {
+    iconcache.splice(iconcache.begin(), iconcache, p);
+  }
+  return iconcache.front().icons;
+}
+
+/**
+ * The pixels covered by a diamond or a circle filling a square of
+ * 'size' pixels, one rectangle per row.
+ */
+static TRegion*
+iconMask(bool diamond, int size)
+{
+  TRegion *mask = new TRegion;
+  double c = size / 2.0;
+  for(int y=0; y<size; ++y) {
+    double dy = fabs(y + 0.5 - c);
+    double half = diamond ? c - dy : sqrt(c*c - dy*dy);
+    int x0 = (int)floor(c - half + 0.5);
+    int x1 = (int)ceil(c + half - 0.5);
+    if (x1 > x0)
+      mask->addRect(x0, y, x1-x0, 1);
+  }
+  return mask;
+}
+
+/**
+ * Copy the icon from the cache onto the screen, rendering it first when
+ * it isn't cached yet.
+ *
+ * \return false when the icon has no background shape, the pen doesn't
+ *         paint on screen or rotates, in which case the icon must be
+ *         painted with paintIcon()
+ */
+static bool
+paintCachedIcon(TPenBase &pen, const string &type, int objid,
+                TFigure *figure, int cx, int cy, TFigure::EPaintType ptype)
+{
+  bool diamond = type.compare(0, 10, "Connector:", 10)==0;
+  bool circle  = type.compare(0, 4, "Map:", 4)==0;
+  if (!diamond && !circle && type.compare(0, 9, "Computer:", 9)!=0)
+    return false;
+  TPen *screen = dynamic_cast<TPen*>(&pen);
+  if (!screen)
+    return false;
+  const TMatrix2D *m = pen.getMatrix();
+  if (m && (m->a12!=0.0 || m->a21!=0.0))
+    return false;
+  double scale = m ? m->a11 : 1.0;
+  if (scale<=0.0 || (m && m->a22!=scale))
+    return false;
+
+  TCachedIcons &icons = cachedIcons(scale);
+  string key = type;
+  key += (char)('0' + ptype);
+  if (circle && objid==0)
+    key += '-'; // painted grey, see paintIcon()
+  TCachedIcons::iterator p = icons.find(key);
+  if (p==icons.end()) {
+    int size = (int)ceil(32 * scale);
+    TCachedIcon icon;
+    icon.bitmap = new TBitmap(size, size, TBitmap::TRUECOLOR);
+    icon.mask = diamond || circle ? iconMask(diamond, size) : 0;
+    {
+      TPen bpen(icon.bitmap);
+      // the background's color, in case rounding leaves a pixel uncovered
+      if (diamond)
+        bpen.setColor(255,255,0);
+      else if (circle && objid==0)
+        bpen.setColor(191,191,191);
+      else
+        bpen.setColor(0,0,255);
+      bpen.fillRectanglePC(0,0,size,size);
+      bpen.scale(scale, scale);
+      paintIcon(bpen, type, objid, figure, 0, 0, ptype);
+    }
+    p = icons.insert(TCachedIcons::value_type(key, icon)).first;
+  }
+
+  int dx = cx, dy = cy;
+  if (m)
+    m->map(cx, cy, &dx, &dy);
+  pen.push();
+  pen.identity();
+  if (p->second.mask) {
+    // restore the clip box instead of the exact damaged region, all
+    // figures within the box are painted anyway, see TNetEditor::paint()
+    TRectangle clip;
+    screen->getClipBox(&clip);
+    TRegion mask(*p->second.mask);
+    mask.translate(dx, dy);
+    *screen &= mask;
+    screen->drawBitmap(dx, dy, p->second.bitmap);
+    screen->setClipRect(clip);
+  } else {
+    screen->drawBitmap(dx, dy, p->second.bitmap);
+  }
+  pen.pop();
+  return true;
+}
+
 void
 TSymbol::paint(TPenBase &pen, EPaintType ptype)
 {
@@ -260,46 +430,22 @@ TSymbol::paint(TPenBase &pen, EPaintType ptype)
   int cx = this->x - w/2;
   int cy = this->y - h/2; 
 
-  loadimages();
-
   map<string, TFigure*>::iterator f = figtxt.find(type);
-  if (f!=figtxt.end()) {
-    TRectangle br;
-    br.set(cx,cy,32,32);
-
-    pen.setColor(0,0,0);
-    pen.setLineWidth(1);
-    if (type.compare(0, 9, "Computer:", 9)==0) {
-      pen.setFillColor(0, 0, 255);
-      pen.fillRectangle(br);
-    } else
-    if (type.compare(0, 10, "Connector:", 10)==0) {
-      pen.setFillColor(255,255,0);
-      TPoint p[4];
-      p[0].set(br.x + br.w / 2, br.y);
-      p[1].set(br.x + br.w    , br.y + br.h / 2);
-      p[2].set(br.x + br.w / 2, br.y + br.h);
-      p[3].set(br.x           , br.y + br.h / 2);
-      pen.fillPolygon(p, 4);
-    } else
-    if (type.compare(0, 4, "Map:", 4)==0) {
-      if (objid==0) // id 0 isn't a valid map
-        pen.setFillColor(191,191,191);
-      else
-        pen.setFillColor(0,0,255);
-      pen.fillCircle(br);
-    }
-
-    TFigure *figure = f->second;
-    pen.push();
-    pen.translate(cx, cy);
-    if (figure->mat)
-      pen.multiply(figure->mat);
-    figure->paint(pen, ptype);
-    pen.pop();
+  double size = w * scaleOf(pen);
+  if (size < LOD_ICON_SIZE) {
+    paintPlaceholder(pen, type, objid, !iconsloaded || f!=figtxt.end(),
+                     cx, cy, w, h);
+    if (ptype!=NORMAL)
+      pen.drawRectanglePC(cx-1,cy-1,w+2,h+2);
+    return;
+  }
 
-    pen.setLineColor(0,0,0);
-    pen.setLineWidth(1);
+  if (!iconsloaded) {
+    paintPlaceholder(pen, type, objid, true, cx, cy, w, h);
+  } else
+  if (f!=figtxt.end()) {
+    if (!paintCachedIcon(pen, type, objid, f->second, cx, cy, ptype))
+      paintIcon(pen, type, objid, f->second, cx, cy, ptype);
   } else {
     pen.setFillColor(255,128,0);
     pen.fillRectanglePC(x,y,w,h);
@@ -309,18 +455,17 @@ TSymbol::paint(TPenBase &pen, EPaintType ptype)
     pen.drawRectanglePC(cx-1,cy-1,w+2,h+2);
   }
 
+  if (size < LOD_LABEL_SIZE)
+    return;
+
   pen.setFillColor(255,255,255);
 
-  pen.setFont("arial,helvetica,sans-serif:size=8");
+  pen.setFont(LABEL_FONT);
   
-  string txt;
-  if (label.empty())
-    txt = sysName;
-  else
-    txt = label;
-
-  int tw = pen.getTextWidth(txt);
-  int th = pen.getHeight();
+  measure();
+  const string &txt = labelText();
+  int tw = labelw;
+  int th = labelh;
   int tx = cx + w/2 - tw/2;
   int ty = cy + h;
   pen.fillRectanglePC(tx-2,ty,tw+4,th+4);
@@ -356,21 +501,14 @@ TSymbol::getShape(TRectangle *rect)
   rect->x -= w/2;
   rect->y -= h/2;
 
-  TFont *fnt = TPen::lookupFont("arial,helvetica,sans-serif:size=10");
-
-  string s;
-  if (label.empty())
-    s = sysName;
-  else
-    s = label;
-
-  int tw = fnt->getTextWidth(s) + 4;
+  measure();
+  int tw = shapew + 4;
   if (tw>rect->w) {
     rect->x = rect->x + rect->w/2 - tw/2;
     rect->w = tw;
   }
   
-  rect->h += fnt->getHeight() + 4;
+  rect->h += shapeh + 4;
   
   rect->x--;
   rect->y--;
@@ -386,6 +524,10 @@ TSymbol::editEvent(TFigureEditEvent &ee)
 
   // no server means that the server does not need to be informed
   if (!model->server) {
+    if (ee.type==TFigureEditEvent::ADDED)
+      model->indexSymbol(this);
+    if (ee.type==TFigureEditEvent::TRANSLATE)
+      model->moved(this);
     return true;
   }
   
@@ -393,24 +535,27 @@ TSymbol::editEvent(TFigureEditEvent &ee)
     // figure was added to model
     case TFigureEditEvent::ADDED:
       id = model->uniqueDeviceID(this);
+      model->indexSymbol(this);
 //      cout << "figure " << id << " was added" << endl;
       model->server->sndAddSymbol(model->id, id, x, y);
       break;
     // figure was removed from a model
     case TFigureEditEvent::REMOVED:
-      cout << "figure was removed" << endl;
-      model->server->sndDeleteSymbol(model->id, id);
+      LOG_TRACE("symbol " << id << " was removed");
+      if (!model->itsme)
+        model->server->sndDeleteSymbol(model->id, id);
       break;
     // figure was moved
     case TFigureEditEvent::TRANSLATE:
       x+=ee.x; y+=ee.y;
+      model->moved(this);
       model->server->sndTranslateSymbol(model->id, id, ee.x, ee.y);
       break;
     case TFigureEditEvent::START_IN_PLACE:
       if (type.compare(0, 4, "Map:", 4)==0) {
         TEditorWindow *ew = dynamic_cast<TEditorWindow*>(ee.editor->getParent());
         assert(ew);
-        cout << "go to edit map id " << objid << endl;
+        LOG_DEBUG("go to edit map id " << objid);
         if (objid>0)
           ew->gotoMapByID(objid);
       } else {
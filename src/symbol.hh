@@ -21,6 +21,9 @@
 #define __NETEDIT_NETDEVICE_HH
 
 #include <toad/figure.hh>
+#include <vector>
+#include <map>
+#include <string>
 
 namespace netedit {
 
@@ -49,6 +52,7 @@ class TConnection:
 
     bool editEvent(TFigureEditEvent &ee);
     void paint(toad::TPenBase&, toad::TFigure::EPaintType);
+    static void paintLines(toad::TPenBase&, const vector<TConnection*>&);
     void getShape(toad::TRectangle*);
     void translate(int, int) {}
     double distance(int, int);
@@ -72,6 +76,10 @@ class TSymbol:
     unsigned port;
     string protocol;
 
+    // connections ending at this symbol, maintained by TMapModel
+    typedef vector<TConnection*> TConnections;
+    TConnections connections;
+
     bool editEvent(TFigureEditEvent &ee);
 
     unsigned mouseLDown(TFigureEditor *editor, int mx, int my, unsigned);
@@ -83,10 +91,24 @@ class TSymbol:
     void getShape(TRectangle*);
     void translate(int dx, int dy);
 
-    TCloneable* clone() const { return new TSymbol(*this); }
+    TCloneable* clone() const {
+      TSymbol *s = new TSymbol(*this);
+      s->connections.clear();
+      return s;
+    }
     const char * getClassName() const { return "netedit::TSymbol"; }
     void store(TOutObjectStream &out) const;
     bool restore(TInObjectStream &in);
+
+  private:
+    // size of the label, valid while its text is 'measured'
+    string measured;
+    int labelw, labelh;  // in the font it's painted with
+    int shapew, shapeh;  // in the font used for the shape
+    const string& labelText() const {
+      return label.empty() ? sysName : label;
+    }
+    void measure();
 };
 
 struct imgtxt_t {
@@ -97,6 +119,8 @@ struct imgtxt_t {
 extern imgtxt_t imgtxt[];
 
 void loadimages();
+void iconsLoaded(map<string, TFigure*> &icons);
+void flushIconCache();
 
 } // namespaace netedit
 